@@ -0,0 +1,263 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <cstring>
+#include <vector>
+
+#include "pyapi.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Arena for the python object allocator domain. It wraps the allocator found
+// at install and stays installed: while active, small blocks are bump
+// allocated from 1 MB chunks of one reserved address range, otherwise
+// everything goes to the wrapped allocator. Blocks are told apart by address,
+// so a block is always freed by the allocator which made it.
+//
+// Freed arena blocks are not reused one by one: a chunk is decommitted as a
+// whole when its last block is freed ( mostly at the interpreter end ). A
+// block which outlives the run keeps only its own chunk.
+//
+// The object domain is used with the GIL held, so there is no locking. The
+// arena is never deleted: python may free its blocks until the process ends.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class ObjectArena
+{
+public:
+
+    static const size_t  chunkSize = 0x100000;
+    static const size_t  largeSize = chunkSize / 16;
+
+    explicit ObjectArena(size_t reserveSize) :
+        m_active(false),
+        m_current(noChunk),
+        m_offset(0),
+        m_used(0),
+        m_committed(0),
+        m_peak(0),
+        m_runPeak(0)
+    {
+        m_chunkCount = reserveSize / chunkSize;
+        m_base = static_cast<char*>(VirtualAlloc(NULL, m_chunkCount * chunkSize, MEM_RESERVE, PAGE_READWRITE));
+        if (!m_base)
+            m_chunkCount = 0;
+
+        m_live.resize(m_chunkCount, 0);
+
+        memset(&m_fallback, 0, sizeof(m_fallback));
+    }
+
+    bool isReserved() const {
+        return m_base != NULL;
+    }
+
+    // wraps the current allocator, the caller passes the result to PyMem_SetAllocator
+    PyMemAllocatorEx wrap(const PyMemAllocatorEx& fallback)
+    {
+        m_fallback = fallback;
+
+        PyMemAllocatorEx  allocator;
+        allocator.ctx = this;
+        allocator.malloc = &ObjectArena::arenaMalloc;
+        allocator.calloc = &ObjectArena::arenaCalloc;
+        allocator.realloc = &ObjectArena::arenaRealloc;
+        allocator.free = &ObjectArena::arenaFree;
+        return allocator;
+    }
+
+    void setActive(bool active)
+    {
+        m_active = active;
+        if (active)
+            m_runPeak = m_committed;
+    }
+
+    size_t committed() const {
+        return m_committed;
+    }
+
+    size_t peak() const {
+        return m_peak;
+    }
+
+    // committed bytes high mark since the last setActive(true)
+    size_t runPeak() const {
+        return m_runPeak;
+    }
+
+private:
+
+    static const size_t  noChunk = static_cast<size_t>(-1);
+
+    // keeps the python 3.8+ object alignment
+    struct BlockHeader {
+        size_t  size;
+        size_t  reserved[16 / sizeof(size_t) - 1];
+    };
+
+    static void* arenaMalloc(void* ctx, size_t size)
+    {
+        return static_cast<ObjectArena*>(ctx)->allocate(size, false);
+    }
+
+    static void* arenaCalloc(void* ctx, size_t nelem, size_t elsize)
+    {
+        if (elsize != 0 && nelem > static_cast<size_t>(-1) / elsize)
+            return NULL;
+
+        return static_cast<ObjectArena*>(ctx)->allocate(nelem * elsize, true);
+    }
+
+    static void* arenaRealloc(void* ctx, void* p, size_t size)
+    {
+        return static_cast<ObjectArena*>(ctx)->reallocate(p, size);
+    }
+
+    static void arenaFree(void* ctx, void* p)
+    {
+        static_cast<ObjectArena*>(ctx)->release(p);
+    }
+
+    bool owns(const void* p) const
+    {
+        return p >= m_base && p < m_base + m_chunkCount * chunkSize;
+    }
+
+    void* allocate(size_t size, bool zero)
+    {
+        size_t  blockSize = sizeof(BlockHeader) + ((size + 15) & ~static_cast<size_t>(15));
+
+        bool  arena = m_active && size != 0 && blockSize <= largeSize;
+
+        if (arena && (m_current == noChunk || m_offset + blockSize > chunkSize))
+            arena = nextChunk();
+
+        if (!arena)
+            return zero ? m_fallback.calloc(m_fallback.ctx, 1, size) : m_fallback.malloc(m_fallback.ctx, size);
+
+        BlockHeader*  header = reinterpret_cast<BlockHeader*>(m_base + m_current * chunkSize + m_offset);
+        header->size = blockSize - sizeof(BlockHeader);
+
+        m_offset += blockSize;
+        ++m_live[m_current];
+
+        // a chunk is reused only after all its blocks were freed
+        if (zero)
+            memset(header + 1, 0, header->size);
+
+        return header + 1;
+    }
+
+    void* reallocate(void* p, size_t size)
+    {
+        if (!p)
+            return allocate(size, false);
+
+        if (!owns(p))
+            return m_fallback.realloc(m_fallback.ctx, p, size);
+
+        size_t  oldSize = (static_cast<BlockHeader*>(p) - 1)->size;
+        if (size <= oldSize && size != 0)
+            return p;
+
+        void*  newp = allocate(size, false);
+        if (!newp)
+            return NULL;
+
+        memcpy(newp, p, size < oldSize ? size : oldSize);
+        release(p);
+        return newp;
+    }
+
+    void release(void* p)
+    {
+        if (!p)
+            return;
+
+        if (!owns(p))
+        {
+            m_fallback.free(m_fallback.ctx, p);
+            return;
+        }
+
+        size_t  chunk = (static_cast<char*>(p) - m_base) / chunkSize;
+
+        if (--m_live[chunk] != 0)
+            return;
+
+        if (chunk == m_current)
+            m_offset = 0;
+        else
+            decommit(chunk);
+    }
+
+    bool nextChunk()
+    {
+        // the full chunk is decommitted by the free of its last block
+        size_t  chunk;
+
+        if (!m_free.empty())
+        {
+            chunk = m_free.back();
+            m_free.pop_back();
+        }
+        else if (m_used < m_chunkCount)
+        {
+            chunk = m_used++;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (!VirtualAlloc(m_base + chunk * chunkSize, chunkSize, MEM_COMMIT, PAGE_READWRITE))
+        {
+            m_free.push_back(chunk);
+            return false;
+        }
+
+        m_committed += chunkSize;
+        if (m_committed > m_peak)
+            m_peak = m_committed;
+        if (m_committed > m_runPeak)
+            m_runPeak = m_committed;
+
+        m_current = chunk;
+        m_offset = 0;
+        return true;
+    }
+
+    void decommit(size_t chunk)
+    {
+        VirtualFree(m_base + chunk * chunkSize, chunkSize, MEM_DECOMMIT);
+        m_committed -= chunkSize;
+        m_free.push_back(chunk);
+    }
+
+    ObjectArena(const ObjectArena&) = delete;
+
+    PyMemAllocatorEx  m_fallback;
+
+    bool  m_active;
+
+    char*  m_base;
+    size_t  m_chunkCount;
+
+    // live blocks of every chunk
+    std::vector<size_t>  m_live;
+    // decommitted chunks
+    std::vector<size_t>  m_free;
+
+    size_t  m_current;
+    size_t  m_offset;
+    size_t  m_used;
+
+    size_t  m_committed;
+    size_t  m_peak;
+    size_t  m_runPeak;
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -35,8 +35,14 @@ Options::Options(const std::string& cmdline) :
     pyMajorVersion(-1),
     pyMinorVersion(-1),
     global(false),
+    isolated(false),
+    scopeSet(false),
     showHelp(false),
-    runModule(false)
+    runModule(false),
+    runCommand(false),
+    runEval(false),
+    timing(false),
+    arena(false)
 {
     args = getArgsList( cmdline );
 
@@ -48,6 +54,7 @@ Options::Options(const std::string& cmdline) :
         {
             global = true;
             globalByDefault = false;
+            scopeSet = true;
             it = args.erase(it);
             continue;
         }
@@ -55,7 +62,33 @@ Options::Options(const std::string& cmdline) :
         if (*it == "--local" || *it == "-l")
         {
             global = false;
+            isolated = false;
             globalByDefault = false;
+            scopeSet = true;
+            it = args.erase(it);
+            continue;
+        }
+
+        if (*it == "--isolated" || *it == "-i")
+        {
+            global = true;
+            isolated = true;
+            globalByDefault = false;
+            scopeSet = true;
+            it = args.erase(it);
+            continue;
+        }
+
+        if (*it == "--timing")
+        {
+            timing = true;
+            it = args.erase(it);
+            continue;
+        }
+
+        if (*it == "--arena")
+        {
+            arena = true;
             it = args.erase(it);
             continue;
         }
@@ -99,6 +132,18 @@ Options::Options(const std::string& cmdline) :
             continue;
         }
 
+        // the code is the next argument whatever it looks like, a breakpoint
+        // one-liner runs in the common namespace unless asked otherwise
+        if (*it == "--command" || *it == "-c" || *it == "--eval" || *it == "-e")
+        {
+            runCommand = *it == "--command" || *it == "-c";
+            runEval = !runCommand;
+            if (!scopeSet)
+                global = true;
+            it = args.erase(it);
+            break;
+        }
+
         break;
     }
 }
@@ -10,16 +10,28 @@ struct Options
     int  pyMajorVersion;
     int  pyMinorVersion;
     bool  global;
+    bool  isolated;
+    bool  scopeSet;
     bool  showHelp;
     bool  runModule;
+    bool  runCommand;
+    bool  runEval;
+    bool  timing;
+    bool  arena;
     std::vector<std::string>  args;
 
     Options() :
         pyMajorVersion(-1),
         pyMinorVersion(-1),
         global(true),
+        isolated(false),
+        scopeSet(false),
         showHelp(false),
-        runModule(false)
+        runModule(false),
+        runCommand(false),
+        runEval(false),
+        timing(false),
+        arena(false)
     {}
 
     Options(const std::string&  cmdline);
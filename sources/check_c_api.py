@@ -1,32 +1,61 @@
-import sys, os, pefile, re
+import sys, os, re
+
+API_ENTRY_RE = re.compile(r"^PYTHON_API_\w+\((.*)\)\s*$")
+API_EXPORTS_RE = re.compile(r"(NULL|\"[^\"]*\")\s*,\s*(NULL|\"[^\"]*\")\s*,\s*(PYAPI_\w+)$")
+
+def get_pe_exports(image):
+    import pefile
+    pe =  pefile.PE(image, fast_load = True)
+    if (not pe.is_dll()):
+        return None
+    pe.parse_data_directories()
+    return [exp.name.decode('ascii') for exp in pe.DIRECTORY_ENTRY_EXPORT.symbols if exp.name]
+
+def get_elf_exports(image):
+    from elftools.elf.elffile import ELFFile
+    with open(image, 'rb') as f:
+        dynsym = ELFFile(f).get_section_by_name('.dynsym')
+        return [sym.name for sym in dynsym.iter_symbols() if sym['st_shndx'] != 'SHN_UNDEF']
+
+def get_major_version(image):
+    find_version = re.findall(r"python(\d)", os.path.basename(image).lower())
+    return int(find_version[0]) if len(find_version) else 3
+
+def get_capi_used(major_version):
+    py_capi_used = []
+    py_api_table = (os.path.join(os.path.dirname(__file__), 'pyapitable.h'))
+    if os.path.isfile(py_api_table):
+        with open(py_api_table, 'r') as f_py_api_table:
+            for line in f_py_api_table.readlines():
+                find_entry = API_ENTRY_RE.findall(line.strip())
+                if not len(find_entry):
+                    continue
+                find_exports = API_EXPORTS_RE.findall(find_entry[0])
+                if not len(find_exports):
+                    continue
+                py2_export, py3_export, required = find_exports[0]
+                export = py3_export if major_version == 3 else py2_export
+                if export != "NULL":
+                    py_capi_used.append((export.strip('"'), required == "PYAPI_REQUIRED"))
+    return py_capi_used
 
 def main():
     if(len(sys.argv) == 2) and (os.path.isfile(sys.argv[1])):
-        pe =  pefile.PE(sys.argv[1], fast_load = True)
-        if (not pe.is_dll()):
+        with open(sys.argv[1], 'rb') as f:
+            is_elf = f.read(4) == b"\x7fELF"
+
+        py_dll_exports = get_elf_exports(sys.argv[1]) if is_elf else get_pe_exports(sys.argv[1])
+        if py_dll_exports is None:
             print(f"{sys.argv[1]} is not a valid DLL")
         else:
-            py_dll_exports = []
-            pe.parse_data_directories()
-            for exp in pe.DIRECTORY_ENTRY_EXPORT.symbols:
-                py_dll_exports.append(exp.name.decode('ascii'))
-
-            py_capi_used = []
-            py_interpret = (os.path.join(os.path.dirname(__file__), 'pyinterpret.cpp'))
-            if os.path.isfile(py_interpret):
-                with open(py_interpret, 'r') as f_py_interpret:
-                    lines = f_py_interpret.readlines()
-                    for line in lines:
-                        find_exports = re.findall(r"^.*GetProcAddress\(.*\"(.*)\".*$", line.strip())
-                        if (len(find_exports)):
-                            py_capi_used.append(find_exports[0])
+            py_capi_used = get_capi_used(get_major_version(sys.argv[1]))
 
             print(f"List of C API calls not found in {sys.argv[1]} exports")
-            for capi_call in py_capi_used:
+            for capi_call, required in py_capi_used:
                 if capi_call not in py_dll_exports:
-                    print(f"{capi_call}")
+                    print(f"{capi_call}" + (" (required)" if required else ""))
     else:
-        print("Need a valid PE file")
+        print("Need a valid PE or ELF file")
 
 if __name__== "__main__":
-    main()
\ No newline at end of file
+    main()
@@ -5,48 +5,419 @@
 #include <atlbase.h>
 #include <comutil.h>
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 #include "pycontext.h"
 #include "pyclass.h"
+#include "perftimer.h"
+#include "manifest.h"
+#include "mpscqueue.h"
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Output text shared by sys.stdout and sys.stderr of one command ( so they
+// keep their relative order ). Text is sent to the engine in batches: when
+// the buffer grows over the size or line limit, when the oldest buffered
+// text is older than the latency limit, on flush(), on stdin reads and at
+// the command end.
+//
+// The latency limit is checked at each write and, while a !py command runs
+// on the thread which initialized python, by the interrupt watcher thread:
+// it schedules a pending call which flushes the buffer on the command
+// thread. The pending call runs only between python instructions, so text
+// buffered before a long call into native code ( Thread.join(), a slow
+// engine request ) is shown after that call returns, and the limit is kept
+// to about InterruptWatcher::pollInterval only. Other commands see the
+// buffered text at their next write.
+//
+// The engine client may be used only by the thread which runs the command,
+// so other threads ( python threads started by the script ) do not print:
+// they put the text into a lock-free queue which the command thread drains
+// at its own writes, flushes, stdin reads, at the command end and, when it
+// runs pending calls, in a pending call scheduled by the writer. A command
+// which waits in Thread.join() gets the text after the join returns.
+//
+// When the queue is full the text goes to an unbounded overflow list under
+// a lock ( grow, the default ), is dropped and counted ( drop ) or the writer
+// waits for room with the GIL released up to a timeout and then uses the
+// overflow list ( block ). Once the overflow list is used every writer puts
+// its text there until the command thread takes it, so the order of each
+// writer is kept. The settings are manifest options:
+//
+// [pykd-ext]
+// outputBufferSize=16384   ; characters, 0 - write through
+// outputBufferLines=256
+// outputLatency=100        ; milliseconds
+// outputQueueSize=1024     ; writes queued by other threads
+// outputBackpressure=grow  ; grow | drop | block
+// outputBlockTimeout=1000  ; milliseconds, for block
+//
+// The command thread closes the buffer at the command end ( DbgStreams ), text
+// written by other threads after that is discarded: it never reaches the
+// engine from a thread other than the command thread.
+//
 //////////////////////////////////////////////////////////////////////////////
 
-class DbgOut
+class DbgOutBuffer
 {
 public:
 
-    DbgOut(PDEBUG_CLIENT client) :
-        m_control(client)
-    {}
+    DbgOutBuffer(PDEBUG_CLIENT client) :
+        m_control(client),
+        m_ownerThreadId(GetCurrentThreadId()),
+        m_pendingCalls(isPendingCallThread()),
+        m_closed(false),
+        m_outer(NULL),
+        m_dml(false),
+        m_lines(0),
+        m_queue((std::max)(Manifest::get().getIntOption("outputQueueSize", 1024), 2)),
+        m_overflowed(false),
+        m_dropped(0)
+    {
+        const Manifest&  manifest = Manifest::get();
+
+        int  sizeLimit = manifest.getIntOption("outputBufferSize", 0x4000);
+        m_sizeLimit = sizeLimit > 0 ? sizeLimit : 0;
+        int  lineLimit = manifest.getIntOption("outputBufferLines", 256);
+        m_lineLimit = lineLimit > 0 ? lineLimit : 0;
+        int  latency = manifest.getIntOption("outputLatency", 100);
+        m_latency = latency > 0 ? latency : 0;
+
+        std::string  backpressure = manifest.getOption("outputBackpressure");
+        m_backpressure = backpressure == "drop" ? BackpressureDrop : backpressure == "block" ? BackpressureBlock : BackpressureGrow;
+        int  blockTimeout = manifest.getIntOption("outputBlockTimeout", 1000);
+        m_blockTimeout = blockTimeout > 0 ? blockTimeout : 0;
+
+        // a flush scheduled for the previous command may never run
+        pendingFlush().scheduled = false;
+
+        // a !py nested in a script prints after the text the script has written so far
+        m_outer = pendingFlush().output.exchange(this);
+        if (m_outer)
+            m_outer->flush();
+    }
 
-    void write(const std::wstring& str)
+    // the last reference may be held by another thread: the engine is not used here
+    ~DbgOutBuffer()
     {
-        AutoRestorePyState  pystate;
+        DbgOutBuffer*  self = this;
+        pendingFlush().output.compare_exchange_strong(self, m_outer);
+    }
 
-        m_control->ControlledOutputWide(
-            DEBUG_OUTCTL_AMBIENT_TEXT, //DEBUG_OUTCTL_THIS_CLIENT,
-            DEBUG_OUTPUT_NORMAL,
-            L"%ws",
-            str.c_str()
-            );
+    IDebugControl4* control() {
+        return m_control;
+    }
 
+    bool closed() const {
+        return m_closed;
     }
 
-    void writedml(const std::wstring& str)
+    void write(const std::wstring& str, bool dml)
+    {
+        if (m_closed)
+            return;
+
+        if (GetCurrentThreadId() != m_ownerThreadId)
+        {
+            enqueue(str, dml);
+            return;
+        }
+
+        drain();
+        append(str, dml);
+    }
+
+    // must be called with the GIL held: it is released while the engine prints
+    void flush()
     {
+        if (GetCurrentThreadId() != m_ownerThreadId)
+            return;
+
+        drain();
+        flushBuffer();
+    }
+
+    // command thread, with the GIL held: prints everything and releases the engine client
+    void close()
+    {
+        if (m_closed || GetCurrentThreadId() != m_ownerThreadId)
+            return;
+
+        flush();
+
+        m_closed = true;
+
+        // the outer command buffer was flushed by the constructor
+        DbgOutBuffer*  self = this;
+        pendingFlush().output.compare_exchange_strong(self, m_outer);
+        pendingFlush().deadline = 0;
+
+        m_control.Release();
+    }
+
+    // true when the text buffered by the command is older than the latency limit
+    // and flushPending is not scheduled yet: the caller must schedule it. Text
+    // queued by other threads schedules the call itself
+    static bool requestFlush()
+    {
+        PendingFlush&  state = pendingFlush();
+
+        ULONGLONG  deadline = state.deadline;
+        if (deadline == 0 || GetTickCount64() < deadline)
+            return false;
+
+        return !state.scheduled.exchange(true);
+    }
+
+    // pending call, runs on the command thread with the GIL held
+    static int flushPending(void*)
+    {
+        PendingFlush&  state = pendingFlush();
+        state.scheduled = false;
+
+        DbgOutBuffer*  output = state.output;
+        if (output)
+            output->flush();
+
+        return 0;
+    }
+
+private:
+
+    enum Backpressure {
+        BackpressureGrow,
+        BackpressureDrop,
+        BackpressureBlock
+    };
+
+    struct QueuedOutput {
+        std::wstring  text;
+        bool  dml;
+    };
+
+    // the buffer of the running command and the time its oldest text is due
+    struct PendingFlush {
+        std::atomic<DbgOutBuffer*>  output;
+        std::atomic<ULONGLONG>  deadline;
+        std::atomic<bool>  scheduled;
+    };
+
+    static PendingFlush& pendingFlush()
+    {
+        static PendingFlush  state;
+        return state;
+    }
+
+    void flushBuffer()
+    {
+        if (m_buffer.empty())
+            return;
+
+        std::wstring  text;
+        text.swap(m_buffer);
+        m_lines = 0;
+        pendingFlush().deadline = 0;
+
         AutoRestorePyState  pystate;
 
-        m_control->ControlledOutputWide(
-            DEBUG_OUTCTL_AMBIENT_DML, //DEBUG_OUTCTL_THIS_CLIENT | DEBUG_OUTCTL_DML,
-            DEBUG_OUTPUT_NORMAL,
-            L"%ws",
-            str.c_str()
-            );
+        emit(text, m_dml);
     }
 
-    void flush() {
+    void append(const std::wstring& str, bool dml)
+    {
+        if (dml != m_dml)
+        {
+            flushBuffer();
+            m_dml = dml;
+        }
+
+        if (m_buffer.empty())
+        {
+            m_timer.restart();
+            pendingFlush().deadline = GetTickCount64() + static_cast<ULONGLONG>(m_latency);
+        }
+
+        m_buffer += str;
+        m_lines += std::count(str.begin(), str.end(), L'\n');
+
+        if (m_buffer.size() >= m_sizeLimit || m_lines >= m_lineLimit || m_timer.elapsed() >= m_latency)
+            flushBuffer();
+    }
+
+    // other threads, with the GIL held
+    void enqueue(const std::wstring& str, bool dml)
+    {
+        QueuedOutput  output = { str, dml };
+
+        if (!m_overflowed && m_queue.tryPush(output))
+        {
+            scheduleDrain();
+            return;
+        }
+
+        // the command thread drains in a pending call while this writer waits
+        scheduleDrain();
+
+        if (m_backpressure == BackpressureDrop)
+        {
+            ++m_dropped;
+            return;
+        }
+
+        if (m_backpressure == BackpressureBlock && !m_overflowed)
+        {
+            AutoRestorePyState  pystate;
+
+            PerfTimer  timer;
+            while (timer.elapsed() < m_blockTimeout && !m_overflowed)
+            {
+                Sleep(1);
+                if (m_queue.tryPush(output))
+                    return;
+            }
+        }
+
+        std::lock_guard<std::mutex>  lock(m_overflowLock);
+
+        // the command thread may have taken the overflow list since the check
+        if (!m_overflowed && m_queue.tryPush(output))
+            return;
+
+        m_overflow.push_back(std::move(output));
+        m_overflowed = true;
+    }
+
+    void scheduleDrain()
+    {
+        if (m_pendingCalls && !pendingFlush().scheduled.exchange(true))
+            Py_AddPendingCall(&flushPending, NULL);
+    }
+
+    void drain()
+    {
+        QueuedOutput  output;
+        while (m_queue.tryPop(output))
+            append(output.text, output.dml);
+
+        // the queue holds only text written before the overflow list was used
+        if (m_overflowed)
+        {
+            std::deque<QueuedOutput>  overflow;
+
+            {
+                std::lock_guard<std::mutex>  lock(m_overflowLock);
+                overflow.swap(m_overflow);
+                m_overflowed = false;
+            }
+
+            for (std::deque<QueuedOutput>::iterator it = overflow.begin(); it != overflow.end(); ++it)
+                append(it->text, it->dml);
+        }
+
+        size_t  dropped = m_dropped.exchange(0);
+        if (dropped != 0)
+            append(L"\n<" + std::to_wstring(dropped) + L" writes from other threads are dropped: output queue is full>\n", false);
+    }
+
+    void emit(std::wstring& text, bool dml)
+    {
+        static const size_t  chunkSize = 0x2000;
+
+        for (size_t pos = 0; pos < text.size(); )
+        {
+            size_t  length = text.size() - pos;
+
+            if (length > chunkSize)
+            {
+                // split huge text on a line end if possible and never inside a surrogate pair
+                size_t  lineEnd = text.rfind(L'\n', pos + chunkSize - 1);
+                length = lineEnd != std::wstring::npos && lineEnd >= pos ? lineEnd - pos + 1 : chunkSize;
+
+                if (IS_HIGH_SURROGATE(text[pos + length - 1]))
+                    --length;
+            }
+
+            // terminate the chunk in place instead of copying it
+            wchar_t  next = text[pos + length];
+            text[pos + length] = L'\0';
+
+            m_control->ControlledOutputWide(
+                dml ? DEBUG_OUTCTL_AMBIENT_DML : DEBUG_OUTCTL_AMBIENT_TEXT,
+                DEBUG_OUTPUT_NORMAL,
+                L"%ws",
+                text.c_str() + pos
+                );
+
+            text[pos + length] = next;
+            pos += length;
+        }
+    }
+
+    CComQIPtr<IDebugControl4>  m_control;
+    DWORD  m_ownerThreadId;
+    bool  m_pendingCalls;
+    std::atomic<bool>  m_closed;
+    DbgOutBuffer*  m_outer;
+
+    std::wstring  m_buffer;
+    bool  m_dml;
+    size_t  m_lines;
+    PerfTimer  m_timer;
+
+    size_t  m_sizeLimit;
+    size_t  m_lineLimit;
+    double  m_latency;
+
+    MpscQueue<QueuedOutput>  m_queue;
+    std::mutex  m_overflowLock;
+    std::deque<QueuedOutput>  m_overflow;
+    std::atomic<bool>  m_overflowed;
+    std::atomic<size_t>  m_dropped;
+    Backpressure  m_backpressure;
+    double  m_blockTimeout;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+class DbgOut
+{
+public:
+
+    DbgOut(const std::shared_ptr<DbgOutBuffer>& output) :
+        m_output(output)
+    {}
+
+    // resident streams are rebound to the output of each command and unbound after it
+    void bind(const std::shared_ptr<DbgOutBuffer>& output) {
+        m_output = output;
+    }
+
+    void write(const std::wstring& str)
+    {
+        // a local reference keeps the output alive if the GIL is released
+        std::shared_ptr<DbgOutBuffer>  output = m_output;
+        if (output)
+            output->write(str, false);
+    }
+
+    void writedml(const std::wstring& str)
+    {
+        std::shared_ptr<DbgOutBuffer>  output = m_output;
+        if (output)
+            output->write(str, true);
+    }
+
+    void flush()
+    {
+        std::shared_ptr<DbgOutBuffer>  output = m_output;
+        if (output)
+            output->flush();
     }
 
     std::wstring encoding() {
@@ -74,7 +445,7 @@ public:
 
 private:
 
-    CComQIPtr<IDebugControl4>  m_control;
+    std::shared_ptr<DbgOutBuffer>  m_output;
 
 };
 
@@ -84,18 +455,32 @@ class DbgIn
 {
 public:
 
-    DbgIn(PDEBUG_CLIENT client) :
-        m_control(client)
+    DbgIn(const std::shared_ptr<DbgOutBuffer>& output) :
+        m_output(output)
     {}
 
+    void bind(const std::shared_ptr<DbgOutBuffer>& output) {
+        m_output = output;
+    }
+
     std::wstring readline()
     {
+        std::shared_ptr<DbgOutBuffer>  output = m_output;
+        if (!output || output->closed())
+            return L"";
+
+        // the prompt must be visible before the engine waits for input
+        output->flush();
+
+        // the command thread may close the output while the GIL is released
+        CComQIPtr<IDebugControl4>  control = output->control();
+
         AutoRestorePyState  pystate;
 
         std::vector<wchar_t>  inputBuffer(0x10000);
 
         ULONG  read = 0;
-        m_control->InputWide(&inputBuffer[0], static_cast<ULONG>(inputBuffer.size()), &read);
+        control->InputWide(&inputBuffer[0], static_cast<ULONG>(inputBuffer.size()), &read);
 
         std::wstring  inputstr = std::wstring(&inputBuffer[0]);
 
@@ -125,8 +510,63 @@ public:
     
 private:
 
-    CComQIPtr<IDebugControl4>  m_control;
+    std::shared_ptr<DbgOutBuffer>  m_output;
 };
 
 //////////////////////////////////////////////////////////////////////////////
+//
+// sys.stdout, sys.stderr and sys.stdin of the active interpreter for one
+// command. The stream objects stay resident in the interpreter, only the
+// output they use is rebound here and unbound ( after a flush ) at the end.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class DbgStreams
+{
+public:
+
+    DbgStreams(PDEBUG_CLIENT client) :
+        m_output(std::make_shared<DbgOutBuffer>(client))
+    {
+        bindStream<DbgOut>("stdout");
+        bindStream<DbgOut>("stderr");
+        bindStream<DbgIn>("stdin");
+    }
+
+    ~DbgStreams()
+    {
+        m_output->close();
+
+        unbindStream<DbgOut>("stdout");
+        unbindStream<DbgOut>("stderr");
+        unbindStream<DbgIn>("stdin");
+    }
+
+    void flush() {
+        m_output->flush();
+    }
+
+private:
+
+    DbgStreams(const DbgStreams&) = delete;
+
+    template<typename T>
+    void bindStream(const char* name)
+    {
+        PyObjectRef  stream(get_resident_pyobject<T>(std::string("sys.") + name, m_output));
+        PySys_SetObject(const_cast<char*>(name), stream);
+    }
+
+    template<typename T>
+    void unbindStream(const char* name)
+    {
+        PyObject*  stream = getInterpreterObject(std::string("sys.") + name);
+        T*  cppobj = stream ? get_cppobject<T>(stream) : NULL;
+        if (cppobj)
+            cppobj->bind(std::shared_ptr<DbgOutBuffer>());
+    }
 
+    std::shared_ptr<DbgOutBuffer>  m_output;
+};
+
+//////////////////////////////////////////////////////////////////////////////
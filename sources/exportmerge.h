@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Export name lookup shared by the image resolver. Nothing here knows the image
+// format: the caller gives the export names in strcmp order ( the PE export name
+// table is sorted by the linker, an ELF .dynsym has to be sorted first ) and gets
+// every matching request back in one merge pass.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct ExportRequest {
+    const char*  exportName;
+    size_t  api;
+
+    bool operator < (const ExportRequest& r) const {
+        return strcmp(exportName, r.exportName) < 0;
+    }
+};
+
+// requests must be sorted, exportName(i) returns the i-th name of the sorted
+// export list and onMatch(i, request) is called for each request found
+template<typename ExportName, typename OnMatch>
+void mergeExports(const std::vector<ExportRequest>& requests, size_t exportCount, ExportName exportName, OnMatch onMatch)
+{
+    auto  request = requests.begin();
+
+    for (size_t i = 0; i < exportCount && request != requests.end(); ++i)
+    {
+        const char*  name = exportName(i);
+
+        while (request != requests.end() && strcmp(request->exportName, name) < 0)
+            ++request;
+
+        for (; request != requests.end() && strcmp(request->exportName, name) == 0; ++request)
+            onMatch(i, *request);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
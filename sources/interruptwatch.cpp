@@ -0,0 +1,292 @@
+#include "stdafx.h"
+
+#include "interruptwatch.h"
+#include "pyinterpret.h"
+#include "dbgout.h"
+#include "manifest.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+InterruptWatcher& InterruptWatcher::get()
+{
+    static InterruptWatcher  watcher;
+    return watcher;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+InterruptWatcher::InterruptWatcher() :
+    m_thread(NULL),
+    m_armed(false),
+    m_commandState(NULL),
+    m_threadId(0),
+    m_pendingCalls(false),
+    m_interrupted(false),
+    m_escalated(false),
+    m_asyncState(NULL),
+    m_armOverhead(0.0),
+    m_lastGeneration(0),
+    m_generation(0),
+    m_delivered(false),
+    m_overhead(0.0),
+    m_cancelLatency(-1.0)
+{
+    m_graceTime = static_cast<DWORD>(Manifest::get().getIntOption("interruptGrace", 1000));
+
+    m_armEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    m_stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::arm(PDEBUG_CLIENT client)
+{
+    PerfTimer  timer;
+
+    PyThreadState*  commandState = PyThreadState_Get();
+    DWORD  threadId = getInterpreterThreadId();
+
+    // pending calls are run only by the thread which initialized python
+    bool  pendingCalls = isPendingCallThread();
+
+    // the watcher may be waiting for the GIL with the lock held
+    PyThreadState*  state = PyEval_SaveThread();
+
+    {
+        std::lock_guard<std::mutex>  lock(m_lock);
+
+        if (!m_thread)
+            m_thread = CreateThread(NULL, 0, threadRoutine, this, 0, NULL);
+
+        if (m_armed)
+        {
+            m_outer.push_back(ArmedCommand());
+            saveCommand(m_outer.back());
+        }
+
+        m_control = client;
+        m_commandState = commandState;
+        m_threadId = threadId;
+        m_pendingCalls = pendingCalls;
+        m_interrupted = false;
+        m_escalated = false;
+        m_asyncState = NULL;
+        m_delivered = false;
+        m_generation = ++m_lastGeneration;
+        m_armed = true;
+
+        SetEvent(m_armEvent);
+    }
+
+    PyEval_RestoreThread(state);
+
+    m_armOverhead = timer.elapsed();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::disarm()
+{
+    PerfTimer  timer;
+
+    // the watcher may be waiting for the GIL with the lock held
+    PyThreadState*  state = PyEval_SaveThread();
+
+    bool  escalated;
+    DWORD  threadId;
+    PyThreadState*  asyncState;
+    double  armOverhead;
+
+    {
+        std::lock_guard<std::mutex>  lock(m_lock);
+
+        escalated = m_escalated;
+        threadId = m_threadId;
+        asyncState = m_asyncState;
+        armOverhead = m_armOverhead;
+
+        m_control.Release();
+
+        m_cancelLatency = m_interrupted ? m_interruptTimer.elapsed() : -1.0;
+
+        if (m_outer.empty())
+        {
+            m_armed = false;
+            m_generation = ++m_lastGeneration;
+            ResetEvent(m_armEvent);
+        }
+        else
+        {
+            restoreCommand(m_outer.back());
+            m_outer.pop_back();
+        }
+    }
+
+    PyEval_RestoreThread(state);
+
+    // the watcher does not touch the state of a disarmed command
+    if (escalated)
+        PyThreadState_SetAsyncExc(threadId, NULL);
+
+    if (asyncState)
+    {
+        PyThreadState_Clear(asyncState);
+        PyThreadState_Delete(asyncState);
+    }
+
+    m_overhead = armOverhead + timer.elapsed();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::saveCommand(ArmedCommand& command) const
+{
+    command.control = m_control;
+    command.commandState = m_commandState;
+    command.threadId = m_threadId;
+    command.pendingCalls = m_pendingCalls;
+    command.interrupted = m_interrupted;
+    command.escalated = m_escalated;
+    command.delivered = m_delivered;
+    command.interruptTimer = m_interruptTimer;
+    command.asyncState = m_asyncState;
+    command.generation = m_generation;
+    command.armOverhead = m_armOverhead;
+}
+
+void InterruptWatcher::restoreCommand(const ArmedCommand& command)
+{
+    m_control = command.control;
+    m_commandState = command.commandState;
+    m_threadId = command.threadId;
+    m_pendingCalls = command.pendingCalls;
+    m_interrupted = command.interrupted;
+    m_escalated = command.escalated;
+    m_delivered = command.delivered;
+    m_interruptTimer = command.interruptTimer;
+    m_asyncState = command.asyncState;
+    m_generation = command.generation;
+    m_armOverhead = command.armOverhead;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::getLastInfo(double& overhead, double& cancelLatency) const
+{
+    overhead = m_overhead;
+    cancelLatency = m_cancelLatency;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::stop()
+{
+    if (!m_thread)
+        return;
+
+    SetEvent(m_stopEvent);
+    WaitForSingleObject(m_thread, INFINITE);
+    CloseHandle(m_thread);
+    m_thread = NULL;
+
+    ResetEvent(m_stopEvent);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+DWORD WINAPI InterruptWatcher::threadRoutine(LPVOID lpParameter)
+{
+    static_cast<InterruptWatcher*>(lpParameter)->watch();
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int InterruptWatcher::quit(void* context)
+{
+    InterruptWatcher&  watcher = get();
+
+    // requested for a command which is over
+    if (static_cast<long>(reinterpret_cast<intptr_t>(context)) != watcher.m_generation)
+        return 0;
+
+    watcher.m_delivered = true;
+
+    PyErr_SetString(PyExc_SystemExit(), "CTRL+BREAK");
+    return -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::watch()
+{
+    HANDLE  events[] = { m_stopEvent, m_armEvent };
+
+    while (WaitForMultipleObjects(_countof(events), events, FALSE, INFINITE) != WAIT_OBJECT_0)
+    {
+        while (WaitForSingleObject(m_stopEvent, pollInterval) == WAIT_TIMEOUT)
+        {
+            std::lock_guard<std::mutex>  lock(m_lock);
+
+            if (!m_armed)
+                break;
+
+            poll();
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::poll()
+{
+    // the output latency limit is kept by a flush on the command thread
+    if (m_pendingCalls && DbgOutBuffer::requestFlush())
+    {
+        PyGILState_STATE  state = PyGILState_Ensure();
+        Py_AddPendingCall(&DbgOutBuffer::flushPending, NULL);
+        PyGILState_Release(state);
+    }
+
+    bool  interrupt = m_control->GetInterrupt() == S_OK;
+
+    if (interrupt && !m_interrupted)
+    {
+        m_interrupted = true;
+        m_interruptTimer.restart();
+
+        if (m_pendingCalls)
+        {
+            PyGILState_STATE  state = PyGILState_Ensure();
+            Py_AddPendingCall(&quit, reinterpret_cast<void*>(static_cast<intptr_t>(m_generation)));
+            PyGILState_Release(state);
+            return;
+        }
+
+        raiseAsyncExit();
+        return;
+    }
+
+    if (!m_interrupted)
+        return;
+
+    // a repeated Ctrl+Break is not ignored even when SystemExit was caught
+    if (interrupt || (!m_delivered && !m_escalated && m_interruptTimer.elapsed() >= m_graceTime))
+        raiseAsyncExit();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void InterruptWatcher::raiseAsyncExit()
+{
+    if (!m_asyncState)
+        m_asyncState = PyThreadState_New(PyThreadState_GetInterpreter(m_commandState));
+
+    PyEval_RestoreThread(m_asyncState);
+    PyThreadState_SetAsyncExc(m_threadId, PyExc_SystemExit());
+    PyEval_SaveThread();
+
+    m_escalated = true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
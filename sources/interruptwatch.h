@@ -0,0 +1,137 @@
+#pragma once
+
+#include <DbgEng.h>
+#include <atlbase.h>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "pyapi.h"
+#include "perftimer.h"
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Ctrl+Break watcher shared by all !py commands. One thread is started by the
+// first command and sleeps on an event while no command is armed; an armed
+// command is polled with IDebugControl::GetInterrupt every pollInterval ms.
+//
+// An interrupt is raised as SystemExit by a pending call when the command runs
+// on the thread which initialized python, otherwise ( or when the pending call
+// did not run in the grace period, or on a second Ctrl+Break ) as an async
+// exception to the interpreter thread.
+//
+// A !py started by a script ( dbgCommand ) is armed over the running one: the
+// outer command is saved and armed again when the nested one is disarmed.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class InterruptWatcher
+{
+public:
+
+    static const DWORD  pollInterval = 20;
+
+    static InterruptWatcher& get();
+
+    // both with the GIL held by the command thread, it is released while m_lock is
+    // taken: the watcher may be waiting for the GIL with the lock held
+    void arm(PDEBUG_CLIENT client);
+
+    void disarm();
+
+    // ms spent in the last arm and disarm, ms from the last interrupt seen to the
+    // command end ( -1 without an interrupt )
+    void getLastInfo(double& overhead, double& cancelLatency) const;
+
+    void stop();
+
+private:
+
+    InterruptWatcher();
+
+    InterruptWatcher(const InterruptWatcher&) = delete;
+
+    static DWORD WINAPI threadRoutine(LPVOID lpParameter);
+
+    static int quit(void* context);
+
+    void watch();
+
+    void poll();
+
+    void raiseAsyncExit();
+
+    struct ArmedCommand {
+        CComQIPtr<IDebugControl>  control;
+        PyThreadState*  commandState;
+        DWORD  threadId;
+        bool  pendingCalls;
+        bool  interrupted;
+        bool  escalated;
+        bool  delivered;
+        PerfTimer  interruptTimer;
+        PyThreadState*  asyncState;
+        long  generation;
+        double  armOverhead;
+    };
+
+    void saveCommand(ArmedCommand& command) const;
+
+    void restoreCommand(const ArmedCommand& command);
+
+    HANDLE  m_thread;
+    HANDLE  m_armEvent;
+    HANDLE  m_stopEvent;
+
+    DWORD  m_graceTime;
+
+    std::mutex  m_lock;
+
+    // state of the armed command, guarded by m_lock
+    bool  m_armed;
+    CComQIPtr<IDebugControl>  m_control;
+    PyThreadState*  m_commandState;
+    DWORD  m_threadId;
+    bool  m_pendingCalls;
+    bool  m_interrupted;
+    bool  m_escalated;
+    PerfTimer  m_interruptTimer;
+    PyThreadState*  m_asyncState;
+    double  m_armOverhead;
+
+    // commands the armed one is nested in, the innermost last
+    std::vector<ArmedCommand>  m_outer;
+    long  m_lastGeneration;
+
+    // checked by the pending call, which runs on the command thread with the GIL
+    std::atomic<long>  m_generation;
+    std::atomic<bool>  m_delivered;
+
+    // of the last disarmed command
+    double  m_overhead;
+    double  m_cancelLatency;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+class InterruptWatch
+{
+public:
+
+    explicit InterruptWatch(PDEBUG_CLIENT client)
+    {
+        InterruptWatcher::get().arm(client);
+    }
+
+    ~InterruptWatch()
+    {
+        InterruptWatcher::get().disarm();
+    }
+
+private:
+
+    InterruptWatch(const InterruptWatch&) = delete;
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,209 @@
+#include "stdafx.h"
+
+#include <sstream>
+#include <vector>
+
+#include "manifest.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+static const char  optionsSection[] = "pykd-ext";
+
+namespace {
+
+std::string getExtensionPath()
+{
+    HMODULE  hmodule = NULL;
+
+    if (!GetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+        reinterpret_cast<LPCSTR>(&Manifest::get), &hmodule))
+        return "";
+
+    std::vector<char>  pathBuffer(MAX_PATH);
+
+    for (;;)
+    {
+        DWORD  length = GetModuleFileNameA(hmodule, &pathBuffer[0], static_cast<DWORD>(pathBuffer.size()));
+        if (length == 0)
+            return "";
+
+        if (length < pathBuffer.size())
+            return std::string(&pathBuffer[0], length);
+
+        pathBuffer.resize(pathBuffer.size() * 2);
+    }
+}
+
+bool isAbsolutePath(const std::string& path)
+{
+    return (path.size() > 1 && path[1] == ':') || (!path.empty() && (path[0] == '\\' || path[0] == '/'));
+}
+
+std::list<std::string> splitPathList(const std::string& pathList)
+{
+    std::list<std::string>  result;
+    std::stringstream  sstr(pathList);
+    std::string  path;
+
+    while (std::getline(sstr, path, ';'))
+    {
+        if (!path.empty())
+            result.push_back(path);
+    }
+
+    return result;
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////
+
+Manifest& Manifest::get()
+{
+    static Manifest  manifest;
+    return manifest;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+Manifest::Manifest() :
+    m_present(false)
+{
+    std::string  extensionPath = getExtensionPath();
+
+    size_t  extPos = extensionPath.rfind('.');
+    size_t  dirPos = extensionPath.find_last_of("\\/");
+    if (extPos == std::string::npos || dirPos == std::string::npos || extPos < dirPos)
+        return;
+
+    m_fileName = extensionPath.substr(0, extPos) + ".ini";
+    m_directory = extensionPath.substr(0, dirPos + 1);
+
+    DWORD  attr = GetFileAttributesA(m_fileName.c_str());
+    if (attr == INVALID_FILE_ATTRIBUTES || (attr & FILE_ATTRIBUTE_DIRECTORY) != 0)
+        return;
+
+    m_present = true;
+
+    std::vector<char>  sections(0x10000);
+    GetPrivateProfileSectionNamesA(&sections[0], static_cast<DWORD>(sections.size()), m_fileName.c_str());
+
+    for (const char* section = &sections[0]; *section; section += strlen(section) + 1)
+    {
+        ManifestInterpreter  desc;
+
+        if (sscanf_s(section, "python%d.%d", &desc.majorVersion, &desc.minorVersion) != 2)
+            continue;
+
+        desc.imagePath = readString(section, "image");
+        if (desc.imagePath.empty())
+            continue;
+
+        if (!isAbsolutePath(desc.imagePath))
+            desc.imagePath = m_directory + desc.imagePath;
+
+        desc.home = readString(section, "home");
+        if (!desc.home.empty() && !isAbsolutePath(desc.home))
+            desc.home = m_directory + desc.home;
+
+        desc.path = splitPathList(readString(section, "path"));
+
+        m_interpreters[std::make_pair(desc.majorVersion, desc.minorVersion)] = desc;
+    }
+
+    std::vector<char>  options(0x10000);
+    GetPrivateProfileSectionA(optionsSection, &options[0], static_cast<DWORD>(options.size()), m_fileName.c_str());
+
+    for (const char* option = &options[0]; *option; option += strlen(option) + 1)
+    {
+        const char*  delim = strchr(option, '=');
+        if (delim)
+            m_options[std::string(option, delim)] = std::string(delim + 1);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+std::string Manifest::readString(const char* section, const char* key, const char* defaultValue) const
+{
+    std::vector<char>  buffer(0x1000);
+    DWORD  length = GetPrivateProfileStringA(section, key, defaultValue, &buffer[0], static_cast<DWORD>(buffer.size()), m_fileName.c_str());
+    return std::string(&buffer[0], length);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+const ManifestInterpreter* Manifest::findInterpreter(int majorVersion, int minorVersion) const
+{
+    auto  it = m_interpreters.find(std::make_pair(majorVersion, minorVersion));
+    return it != m_interpreters.end() ? &it->second : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+bool Manifest::getDefaultVersion(int& majorVersion, int& minorVersion) const
+{
+    std::string  version = getOption("default");
+
+    int  major = -1, minor = -1;
+    if (sscanf_s(version.c_str(), "%d.%d", &major, &minor) != 2)
+        return false;
+
+    majorVersion = major;
+    minorVersion = minor;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void Manifest::setDefaultVersion(int majorVersion, int minorVersion)
+{
+    if (!m_present)
+        return;
+
+    std::stringstream  sstr;
+    sstr << majorVersion << '.' << minorVersion;
+
+    m_options["default"] = sstr.str();
+
+    WritePrivateProfileStringA(optionsSection, "default", sstr.str().c_str(), m_fileName.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+std::string Manifest::getOption(const char* name, const char* defaultValue) const
+{
+    auto  it = m_options.find(name);
+    return it != m_options.end() ? it->second : defaultValue;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int Manifest::getIntOption(const char* name, int defaultValue) const
+{
+    auto  it = m_options.find(name);
+    return it != m_options.end() && !it->second.empty() ? atoi(it->second.c_str()) : defaultValue;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+std::list<std::string> Manifest::getListOption(const char* name) const
+{
+    return splitPathList(getOption(name));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+std::list<std::string> Manifest::getPathListOption(const char* name) const
+{
+    std::list<std::string>  paths = getListOption(name);
+
+    for (std::string& path : paths)
+    {
+        if (!isAbsolutePath(path))
+            path = m_directory + path;
+    }
+
+    return paths;
+}
+
+//////////////////////////////////////////////////////////////////////////////
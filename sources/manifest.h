@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <map>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Optional interpreter manifest: an ini file next to the extension dll with
+// the same base name ( pykd.dll -> pykd.ini ). When it has at least one
+// [pythonX.Y] section ( or registry=0 ), interpreters are taken from it and
+// the registry is not read at all. A manifest with options only keeps the
+// registry discovery.
+//
+// [pykd-ext]
+// registry=0                   ; never read the registry, even without interpreter sections
+// default=3.11                 ; default interpreter, updated by !select
+// preload=1                    ; start the default interpreter at .load, on a
+//                              ; background thread which becomes its python main
+//                              ; thread: commands get no pending calls or signals
+// preloadModules=pykd;ctypes  ; modules imported by the preload
+// localPool=4                 ; sub-interpreters kept ready for !py --local
+// teardownQueue=4              ; finished --local interpreters ended in the background
+// arenaReserve=1024            ; MB of address space reserved for !py --arena
+// scriptPath=scripts;D:\tools  ; indexed directories searched first for !py scripts
+// interruptGrace=1000          ; ms before CTRL+BREAK is forced as an async exception
+// sourceCache=64               ; compiled !py -c / -e sources kept by every interpreter
+//
+// [python3.11]                 ; one section per interpreter
+// image=C:\conda\envs\triage\python311.dll   ; relative to the manifest
+// home=C:\conda\envs\triage    ; optional, passed to Py_SetPythonHome
+// path=D:\triage\lib;D:\tools  ; optional, prepended to sys.path
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct ManifestInterpreter {
+    int  majorVersion;
+    int  minorVersion;
+    std::string  imagePath;
+    std::string  home;
+    std::list<std::string>  path;
+};
+
+class Manifest
+{
+public:
+
+    static Manifest& get();
+
+    bool isPresent() const {
+        return m_present;
+    }
+
+    // the interpreter list comes from the manifest alone
+    bool replacesRegistry() const {
+        return m_present && (!m_interpreters.empty() || getIntOption("registry", 1) == 0);
+    }
+
+    const std::map<std::pair<int, int>, ManifestInterpreter>& interpreters() const {
+        return m_interpreters;
+    }
+
+    const ManifestInterpreter* findInterpreter(int majorVersion, int minorVersion) const;
+
+    bool getDefaultVersion(int& majorVersion, int& minorVersion) const;
+
+    void setDefaultVersion(int majorVersion, int minorVersion);
+
+    std::string getOption(const char* name, const char* defaultValue = "") const;
+
+    int getIntOption(const char* name, int defaultValue) const;
+
+    std::list<std::string> getListOption(const char* name) const;
+
+    // as getListOption, relative entries are resolved against the manifest directory
+    std::list<std::string> getPathListOption(const char* name) const;
+
+private:
+
+    Manifest();
+
+    Manifest(const Manifest&) = delete;
+
+    std::string readString(const char* section, const char* key, const char* defaultValue = "") const;
+
+    std::string  m_fileName;
+    std::string  m_directory;
+    bool  m_present;
+    std::map<std::pair<int, int>, ManifestInterpreter>  m_interpreters;
+    std::map<std::string, std::string>  m_options;
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Read-only view of a whole file. The file is shared for reading and delete
+// ( an editor may save the script by replacing it ), not for writing: a write
+// past the end of file would go into the zero filled rest of the last page
+// which terminates the view ( see c_str ). close() lets writers in as soon
+// as the content is no longer needed.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class MappedFile
+{
+public:
+
+    explicit MappedFile(const std::string& path) :
+        m_mapping(NULL),
+        m_view(NULL),
+        m_size(0),
+        m_writeTime(0),
+        m_open(false)
+    {
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+            return;
+
+        LARGE_INTEGER  size;
+        if (!GetFileSizeEx(m_file, &size))
+            return;
+
+        m_size = static_cast<size_t>(size.QuadPart);
+
+        FILETIME  writeTime;
+        if (!GetFileTime(m_file, NULL, NULL, &writeTime))
+            return;
+
+        m_writeTime = (static_cast<unsigned long long>(writeTime.dwHighDateTime) << 32) | writeTime.dwLowDateTime;
+
+        // an empty file can not be mapped
+        if (m_size == 0)
+        {
+            m_open = true;
+            return;
+        }
+
+        m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!m_mapping)
+            return;
+
+        m_view = static_cast<const char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+        m_open = m_view != NULL;
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    // data() is empty after the close, size() and writeTime() are kept
+    void close()
+    {
+        if (m_view)
+            UnmapViewOfFile(m_view);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+
+        m_view = NULL;
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+        m_copy.clear();
+    }
+
+    bool isOpen() const {
+        return m_open;
+    }
+
+    const char* data() const {
+        return m_view ? m_view : "";
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    unsigned long long writeTime() const {
+        return m_writeTime;
+    }
+
+    // The content as a NUL terminated string. The rest of the last page after
+    // the end of file is zero filled, so the view is used as is unless the file
+    // ends exactly at a page boundary.
+    const char* c_str()
+    {
+        if (!m_view)
+            return "";
+
+        SYSTEM_INFO  systemInfo;
+        GetSystemInfo(&systemInfo);
+
+        if (m_size % systemInfo.dwPageSize != 0)
+            return m_view;
+
+        if (m_copy.empty())
+        {
+            m_copy.assign(m_view, m_view + m_size);
+            m_copy.push_back('\0');
+        }
+
+        return &m_copy[0];
+    }
+
+private:
+
+    MappedFile(const MappedFile&) = delete;
+
+    HANDLE  m_file;
+    HANDLE  m_mapping;
+    const char*  m_view;
+    size_t  m_size;
+    unsigned long long  m_writeTime;
+    bool  m_open;
+
+    std::vector<char>  m_copy;
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Bounded lock-free queue for many producers and one consumer ( D. Vyukov's
+// bounded queue with a plain consumer index ). Each cell carries a sequence
+// number: a producer claims a position by CAS on the enqueue index, stores
+// the value and publishes it by advancing the cell sequence. The order of
+// values pushed by one thread is kept.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+template<typename T>
+class MpscQueue
+{
+public:
+
+    // capacity is rounded up to a power of two
+    explicit MpscQueue(size_t capacity)
+    {
+        size_t  size = 2;
+        while (size < capacity)
+            size *= 2;
+
+        m_mask = size - 1;
+        m_cells.reset(new Cell[size]);
+
+        for (size_t i = 0; i < size; ++i)
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+
+        m_enqueuePos.store(0, std::memory_order_relaxed);
+        m_dequeuePos = 0;
+    }
+
+    // moves the value into the queue, the value is untouched when the queue is full
+    bool tryPush(T& value)
+    {
+        size_t  pos = m_enqueuePos.load(std::memory_order_relaxed);
+
+        for (;;)
+        {
+            Cell&  cell = m_cells[pos & m_mask];
+            size_t  sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t  diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0)
+            {
+                if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = m_enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // must be called from the consumer thread only
+    bool tryPop(T& value)
+    {
+        Cell&  cell = m_cells[m_dequeuePos & m_mask];
+
+        if (cell.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1)
+            return false;
+
+        value = std::move(cell.value);
+        cell.sequence.store(m_dequeuePos + m_mask + 1, std::memory_order_release);
+        ++m_dequeuePos;
+        return true;
+    }
+
+private:
+
+    MpscQueue(const MpscQueue&) = delete;
+
+    struct Cell {
+        std::atomic<size_t>  sequence;
+        T  value;
+    };
+
+    std::unique_ptr<Cell[]>  m_cells;
+    size_t  m_mask;
+
+    // keep the producer and the consumer index on different cache lines
+    char  m_pad0[64];
+    std::atomic<size_t>  m_enqueuePos;
+    char  m_pad1[64];
+    size_t  m_dequeuePos;
+};
+
+//////////////////////////////////////////////////////////////////////////////
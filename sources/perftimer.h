@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Windows.h>
+
+//////////////////////////////////////////////////////////////////////////////
+
+class PerfTimer
+{
+public:
+
+    PerfTimer()
+    {
+        restart();
+    }
+
+    void restart()
+    {
+        QueryPerformanceCounter(&m_start);
+    }
+
+    // milliseconds since construction or the last restart
+    double elapsed() const
+    {
+        LARGE_INTEGER  now, freq;
+        QueryPerformanceCounter(&now);
+        QueryPerformanceFrequency(&freq);
+        return (now.QuadPart - m_start.QuadPart) * 1000.0 / freq.QuadPart;
+    }
+
+private:
+
+    LARGE_INTEGER  m_start;
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,176 @@
+#include "stdafx.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "preamble.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+bool isBlank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\f' || c == '\r';
+}
+
+bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+const char* skipBlank(const char* p, const char* end)
+{
+    while (p < end && isBlank(*p))
+        ++p;
+    return p;
+}
+
+bool startsWith(const char* p, const char* end, const char* prefix)
+{
+    size_t  length = strlen(prefix);
+    return static_cast<size_t>(end - p) >= length && memcmp(p, prefix, length) == 0;
+}
+
+// "#!" blank* "python" (2|3) ( "." digit+ )? blank*
+bool parseShebang(const char* p, const char* end, int& majorVersion, int& minorVersion)
+{
+    p = skipBlank(p + 2, end);
+
+    if (!startsWith(p, end, "python"))
+        return false;
+    p += 6;
+
+    if (p == end || (*p != '2' && *p != '3'))
+        return false;
+    int  major = *p++ - '0';
+
+    int  minor = -1;
+    if (p < end && *p == '.')
+    {
+        ++p;
+        if (p == end || !isDigit(*p))
+            return false;
+
+        minor = 0;
+        while (p < end && isDigit(*p) && minor < 1000)
+            minor = minor * 10 + (*p++ - '0');
+    }
+
+    if (skipBlank(p, end) != end)
+        return false;
+
+    majorVersion = major;
+    minorVersion = minor;
+    return true;
+}
+
+void applyDirective(ScriptPreamble& preamble, const std::string& directive)
+{
+    if (directive == "global" || directive == "local" || directive == "isolated")
+    {
+        preamble.scopeSet = true;
+        preamble.global = directive != "local";
+        preamble.isolated = directive == "isolated";
+        return;
+    }
+
+    if (directive == "no-pykd")
+    {
+        preamble.noPykd = true;
+        return;
+    }
+
+    if (directive.compare(0, 8, "preload=") == 0)
+    {
+        size_t  pos = 8;
+        while (pos < directive.size())
+        {
+            size_t  delim = directive.find(',', pos);
+            if (delim == std::string::npos)
+                delim = directive.size();
+
+            if (delim > pos)
+                preamble.preload.push_back(directive.substr(pos, delim - pos));
+
+            pos = delim + 1;
+        }
+        return;
+    }
+
+    throw std::invalid_argument(std::string("unknown pykd-ext directive: ") + directive + "\n");
+}
+
+// "pykd-ext:" ( blank* directive )*, directives are separated by blanks
+void parseDirectives(ScriptPreamble& preamble, const char* p, const char* end)
+{
+    for (;;)
+    {
+        p = skipBlank(p, end);
+        if (p == end)
+            break;
+
+        const char*  word = p;
+        while (p < end && !isBlank(*p))
+            ++p;
+
+        applyDirective(preamble, std::string(word, p));
+    }
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////
+
+ScriptPreamble::ScriptPreamble(const char* data, size_t size) :
+    majorVersion(-1),
+    minorVersion(-1),
+    scopeSet(false),
+    global(false),
+    isolated(false),
+    noPykd(false)
+{
+    const char*  p = data;
+    const char*  end = data + (size < scanSize ? size : scanSize);
+
+    // UTF-8 BOM
+    if (startsWith(p, end, "\xEF\xBB\xBF"))
+        p += 3;
+
+    for (int lineNumber = 1; p < end; ++lineNumber)
+    {
+        const char*  eol = static_cast<const char*>(memchr(p, '\n', end - p));
+
+        // a line cut by the scan size is not looked at
+        if (!eol && end != data + size)
+            break;
+
+        const char*  lineEnd = eol ? eol : end;
+        const char*  text = skipBlank(p, lineEnd);
+
+        if (text != lineEnd)
+        {
+            if (*text != '#')
+                break;
+
+            if (lineNumber == 1 && text == p && startsWith(text, lineEnd, "#!"))
+            {
+                parseShebang(text, lineEnd, majorVersion, minorVersion);
+            }
+            else
+            {
+                const char*  comment = skipBlank(text + 1, lineEnd);
+
+                if (startsWith(comment, lineEnd, "pykd-ext:"))
+                    parseDirectives(*this, comment + 9, lineEnd);
+            }
+        }
+
+        if (!eol)
+            break;
+
+        p = eol + 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
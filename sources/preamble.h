@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <list>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Leading comment lines of a script, read once from its first bytes:
+//
+// #!python3.12                     ; interpreter version, the minor is optional
+// # -*- coding: cp1251 -*-         ; PEP 263 cookie, an ordinary comment here
+// # pykd-ext: isolated no-pykd     ; directives, separated by blanks
+// # pykd-ext: preload=ctypes,json
+//
+// Directives:
+//   global | local | isolated      - namespace as !py -g, -l, -i
+//   no-pykd                        - no "from pykd import *" in the isolated namespace
+//   preload=module[,module]        - modules imported before the script runs
+//
+// The scan stops at the first line which is neither a comment nor blank. The
+// coding cookie is not read: the script bytes are passed to Py_CompileString
+// as they are and its tokenizer decodes them by the cookie.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct ScriptPreamble
+{
+    static const size_t  scanSize = 512;
+
+    int  majorVersion;
+    int  minorVersion;
+    bool  scopeSet;
+    bool  global;
+    bool  isolated;
+    bool  noPykd;
+    std::list<std::string>  preload;
+
+    ScriptPreamble() :
+        majorVersion(-1),
+        minorVersion(-1),
+        scopeSet(false),
+        global(false),
+        isolated(false),
+        noPykd(false)
+    {}
+
+    // throws std::invalid_argument for an unknown pykd-ext directive
+    ScriptPreamble(const char* data, size_t size);
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <atomic>
 
 typedef void*  PyObject;
 typedef void*  PyThreadState;
+typedef void*  PyInterpreterState;
 typedef PyObject *(*PyCFunction)(PyObject *, PyObject *);
 
 
@@ -13,6 +15,11 @@ const int Py_file_input = 257;
 const int Py_eval_input = 258;
 
 const int METH_VARARGS = 0x0001;
+const int METH_NOARGS = 0x0004;
+const int METH_O = 0x0008;
+const int METH_FASTCALL = 0x0080;   // python 3.7+
+
+typedef PyObject *(*PyCFunctionFast)(PyObject *, PyObject *const *, size_t);
 
 struct PyMethodDef {
     const char  *ml_name;   /* The name of the built-in function/method */
@@ -22,17 +29,152 @@ struct PyMethodDef {
     const char  *ml_doc;    /* The __doc__ attribute, or NULL */
 };
 
+typedef void (*destructor)(PyObject *);
+typedef void (*freefunc)(void *);
+typedef PyObject *(*newfunc)(PyObject *, PyObject *, PyObject *);
+typedef PyObject *(*getter)(PyObject *, void *);
+typedef int (*setter)(PyObject *, PyObject *, void *);
+
+struct PyGetSetDef {
+    const char  *name;
+    getter  get;
+    setter  set;
+    const char  *doc;
+    void  *closure;
+};
+
+struct PyType_Slot {
+    int  slot;
+    void  *pfunc;
+};
+
+struct PyType_Spec {
+    const char  *name;
+    int  basicsize;
+    int  itemsize;
+    unsigned int  flags;
+    PyType_Slot  *slots;
+};
+
+// python 3 typeslots.h
+const int Py_tp_dealloc = 52;
+const int Py_tp_methods = 64;
+const int Py_tp_new = 65;
+const int Py_tp_getset = 73;
+const int Py_tp_free = 74;
+
+// python 3 Py_TPFLAGS_HAVE_VERSION_TAG
+const unsigned int Py_TPFLAGS_DEFAULT = 1UL << 18;
+
+// python 2.7 layout: python 3 has no smalltable, the extra space is not used there
+struct Py_buffer {
+    void  *buf;
+    PyObject  *obj;
+    size_t  len;
+    size_t  itemsize;
+    int  readonly;
+    int  ndim;
+    char  *format;
+    size_t  *shape;
+    size_t  *strides;
+    size_t  *suboffsets;
+    size_t  smalltable[2];
+    void  *internal;
+};
+
+const int PyBUF_SIMPLE = 0;
+
+// python 3.5+
+struct PyMemAllocatorEx {
+    void  *ctx;
+    void* (*malloc)(void *ctx, size_t size);
+    void* (*calloc)(void *ctx, size_t nelem, size_t elsize);
+    void* (*realloc)(void *ctx, void *ptr, size_t new_size);
+    void (*free)(void *ctx, void *ptr);
+};
+
+const int PYMEM_DOMAIN_OBJ = 2;
+
 typedef struct PyMethodDef PyMethodDef;
 
-void Py_IncRef(PyObject* object);
-void Py_DecRef(PyObject* object);
+// How the refcount in the object header is changed for the loaded interpreter.
+// Release builds of python 2.x and 3.x up to 3.14 keep ob_refcnt as the first
+// pointer sized field, so the count is changed inline. Since 3.12 immortal
+// objects must not be touched: on 64-bit they have the low 32 bits of the count
+// negative. Other versions ( and 32-bit 3.12+, free-threaded builds ) go through
+// the dll exports, and so does every version while more than one is loaded.
+enum PyRefcountMode {
+    PyRefcountDispatch,
+    PyRefcountInline,
+    PyRefcountInlineImmortal
+};
+
+// set when an interpreter version is loaded, read by every thread calling the wrappers
+extern std::atomic<PyRefcountMode>  pyRefcountMode;
+
+void PyIncRefDispatch(PyObject* object);
+void PyDecRefDispatch(PyObject* object);
+
+inline void Py_IncRef(PyObject* object)
+{
+    if (!object)
+        return;
+
+    size_t&  refcnt = *reinterpret_cast<size_t*>(object);
+
+    switch (pyRefcountMode.load(std::memory_order_relaxed))
+    {
+    case PyRefcountInline:
+        ++refcnt;
+        return;
+
+    case PyRefcountInlineImmortal:
+        if ((refcnt & 0x80000000) == 0)
+            ++refcnt;
+        return;
+
+    default:
+        PyIncRefDispatch(object);
+    }
+}
+
+inline void Py_DecRef(PyObject* object)
+{
+    if (!object)
+        return;
+
+    size_t&  refcnt = *reinterpret_cast<size_t*>(object);
+
+    switch (pyRefcountMode.load(std::memory_order_relaxed))
+    {
+    case PyRefcountInlineImmortal:
+        if ((refcnt & 0x80000000) != 0)
+            return;
+        // fall through
+    case PyRefcountInline:
+        // the last reference is released by python: it deallocates the object
+        if (refcnt > 1)
+        {
+            --refcnt;
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    PyDecRefDispatch(object);
+}
 
 PyObject* PyString_FromString(const char *v);
 char* PyString_AsString(PyObject *string);
+size_t PyString_Size(PyObject *string);
 int PyString_Check(PyObject *o);
 
 int PyBytes_Check(PyObject *bytes);
 char* PyBytes_AsString(PyObject *bytes);
+size_t PyBytes_Size(PyObject *bytes);
 
 PyObject* PyImport_Import(PyObject *name);
 PyObject* PyImport_ImportModule(const char *name);
@@ -46,6 +188,7 @@ PyObject* PyTuple_GetItem(PyObject *p, size_t pos);
 int PyTuple_SetItem(PyObject *p, size_t pos, PyObject *obj);
 PyObject* PyDict_GetItemString(PyObject *p, const char *key);
 void PyDict_Clear(PyObject *p);
+PyObject* PyDict_Copy(PyObject *p);
 size_t PyTuple_Size(PyObject *p);
 
 size_t PyList_Size(PyObject* list);
@@ -59,6 +202,13 @@ PyObject* PyInstance_New(PyObject *classobj, PyObject *arg, PyObject *kw);
 PyThreadState* PyEval_SaveThread();
 void PyEval_RestoreThread(PyThreadState *tstate);
 
+PyThreadState* PyThreadState_Get();
+PyThreadState* PyThreadState_New(PyInterpreterState *interp);
+void PyThreadState_Clear(PyThreadState *tstate);
+void PyThreadState_Delete(PyThreadState *tstate);
+int PyThreadState_SetAsyncExc(unsigned long id, PyObject *exc);
+PyInterpreterState* PyThreadState_GetInterpreter(PyThreadState *tstate);
+
 int PySys_SetObject(char *name, PyObject *v);
 PyObject* PySys_GetObject(char *name);
 void PySys_SetArgv(int argc, char **argv);
@@ -66,8 +216,8 @@ void PySys_SetArgv_Py3(int argc, wchar_t **argv);
 
 int PyRun_SimpleString(const char* str);
 PyObject* PyRun_String(const char *str, int start, PyObject *globals, PyObject *locals);
-PyObject* PyRun_File(FILE *fp, const char *filename, int start, PyObject *globals, PyObject *locals);
-PyObject* PyRun_FileExFlags(FILE *fp, const char *filename, int start, PyObject *globals, PyObject *locals, int closeit, void *flags);
+PyObject* Py_CompileString(const char *str, const char *filename, int start);
+PyObject* PyEval_EvalCode(PyObject *co, PyObject *globals, PyObject *locals);
 
 typedef void(*PyCapsule_Destructor)(PyObject *);
 PyObject* PyCapsule_New(void *pointer, const char *name, PyCapsule_Destructor destructor);
@@ -77,11 +227,24 @@ int PyObject_SetAttrString(PyObject *o, const char *attr_name, PyObject *v);
 PyObject* PyObject_GetAttrString(PyObject *o, const char *attr_name);
 PyObject* PyObject_CallObject(PyObject *callable_object, PyObject *args);
 PyObject* PyObject_Call(PyObject *callable_object, PyObject *args, PyObject *kw);
+size_t PyObject_Size(PyObject *o);
 
 PyObject* PyUnicode_FromWideChar(const wchar_t *w, size_t size);
 int PyUnicode_Check(PyObject *o);
 
 PyObject* PyBool_FromLong(long v);
+int PyObject_IsTrue(PyObject *o);
+
+long long PyLong_AsLongLong(PyObject *o);
+unsigned long long PyLong_AsUnsignedLongLong(PyObject *o);
+PyObject* PyLong_FromLongLong(long long v);
+PyObject* PyLong_FromUnsignedLongLong(unsigned long long v);
+
+PyObject* PyString_FromStringAndSize(const char *v, size_t len);
+PyObject* PyBytes_FromStringAndSize(const char *v, size_t len);
+
+int PyObject_GetBuffer(PyObject *obj, Py_buffer *view, int flags);
+void PyBuffer_Release(Py_buffer *view);
 
 PyObject* Py_None();
 PyObject* PyExc_SystemExit();
@@ -93,10 +256,8 @@ void PyErr_Fetch(PyObject **ptype, PyObject **pvalue, PyObject **ptraceback);
 void PyErr_NormalizeException(PyObject**exc, PyObject**val, PyObject**tb);
 void PyErr_SetString(PyObject *type, const char *message);
 void PyErr_Clear();
+PyObject* PyErr_Occurred();
 
-PyObject* PyFile_FromString(char *filename, char *mode);
-FILE* PyFile_AsFile(PyObject *pyfile);
-FILE* _Py_fopen_obj(PyObject *pyfile, const char* mode);
 
 PyObject* PyUnicode_FromString(const char*  str);
 PyObject* PyInstanceMethod_New(PyObject *func);
@@ -108,9 +269,15 @@ void PyGILState_Release(PyGILState_STATE);
 
 PyObject* PyDescr_NewMethod(PyObject* type, struct PyMethodDef *meth);
 
+PyObject* PyType_FromSpec(PyType_Spec *spec);
+PyObject* PyType_GenericAlloc(PyObject *type, size_t nitems);
+void* PyType_GetSlot(PyObject *type, int slot);
+void PyObject_Free(void *p);
+
 size_t PyGC_Collect(void);
 
 bool IsPy3();
+int PyMinorVersion();
 
 class  PyObjectRef;
 
@@ -160,6 +327,11 @@ public:
         m_obj = obj;
     }
 
+    PyObjectRef(PyObjectRef&& ref) : m_obj(ref.m_obj)
+    {
+        ref.m_obj = nullptr;
+    }
+
     ~PyObjectRef()
     {
         if (m_obj)
@@ -210,6 +382,27 @@ public:
         return *this;
     }
 
+    PyObjectRef& operator= (PyObjectRef&& ref)
+    {
+        PyObject*  obj = ref.m_obj;
+        ref.m_obj = nullptr;
+
+        if (m_obj)
+            Py_DecRef(m_obj);
+
+        m_obj = obj;
+
+        return *this;
+    }
+
+    // gives the reference away
+    PyObject* release()
+    {
+        PyObject*  obj = m_obj;
+        m_obj = nullptr;
+        return obj;
+    }
+
 private:
 
     PyObjectRef(const PyObjectRef& obj) = delete;
@@ -218,5 +411,25 @@ private:
 };
 
 
+// Borrowed reference without own refcount: only for objects kept alive by
+// someone else for the whole lifetime of the view ( items of a list held by
+// a PyObjectRef and not changed meanwhile )
+class PyObjectView
+{
+public:
+
+    PyObjectView(PyObject* obj) : m_obj(obj)
+    {}
+
+    operator PyObject*() const
+    {
+        return m_obj;
+    }
+
+private:
+
+    PyObject*  m_obj;
+};
+
 
 
@@ -0,0 +1,120 @@
+// Python C API used by the bootstrapper.
+//
+// The file is included several times with different definitions of the entry
+// macros ( see pymodule.h ) and is parsed by check_c_api.py, so keep one entry
+// per line.
+//
+// PYTHON_API_DATA(type, name, py2Export, py3Export, required)
+//      address of an exported object ( type objects, singletons )
+// PYTHON_API_DATA_PTR(name, py2Export, py3Export, required)
+//      exported PyObject* variable ( exception classes )
+// PYTHON_API_FUNC(ret, name, args, py2Export, py3Export, required)
+//      exported function
+//
+// NULL export means the API is not available for this major version.
+// A required API missing from the image fails the interpreter load,
+// an optional one fails only the call that needs it.
+
+PYTHON_API_DATA(PyObject*, PyType_Type, "PyType_Type", "PyType_Type", PYAPI_REQUIRED)
+PYTHON_API_DATA(PyObject*, PyProperty_Type, "PyProperty_Type", "PyProperty_Type", PYAPI_REQUIRED)
+PYTHON_API_DATA(PyObject*, PyUnicode_Type, "PyUnicode_Type", "PyUnicode_Type", PYAPI_REQUIRED)
+PYTHON_API_DATA(PyObject*, PyString_Type, "PyString_Type", NULL, PYAPI_REQUIRED)
+PYTHON_API_DATA(PyObject*, PyBytes_Type, NULL, "PyBytes_Type", PYAPI_REQUIRED)
+PYTHON_API_DATA(PyObject*, Py_None, "_Py_NoneStruct", "_Py_NoneStruct", PYAPI_REQUIRED)
+PYTHON_API_DATA(PyThreadState**, PyThreadState_Current, "_PyThreadState_Current", NULL, PYAPI_REQUIRED)
+PYTHON_API_DATA_PTR(PyExc_SystemExit, "PyExc_SystemExit", "PyExc_SystemExit", PYAPI_REQUIRED)
+PYTHON_API_DATA_PTR(PyExc_TypeError, "PyExc_TypeError", "PyExc_TypeError", PYAPI_REQUIRED)
+
+PYTHON_API_FUNC(void, Py_Initialize, (), "Py_Initialize", "Py_Initialize", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, Py_Finalize, (), "Py_Finalize", "Py_Finalize", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, Py_SetPythonHome, (char *home), "Py_SetPythonHome", NULL, PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, Py_SetPythonHome_Py3, (wchar_t *home), NULL, "Py_SetPythonHome", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyThreadState*, Py_NewInterpreter, (), "Py_NewInterpreter", "Py_NewInterpreter", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, Py_EndInterpreter, (PyThreadState *tstate), "Py_EndInterpreter", "Py_EndInterpreter", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, Py_IncRef, (PyObject* object), "Py_IncRef", "Py_IncRef", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, Py_DecRef, (PyObject* object), "Py_DecRef", "Py_DecRef", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyEval_GetGlobals, (), "PyEval_GetGlobals", "PyEval_GetGlobals", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, PyEval_InitThreads, (), "PyEval_InitThreads", "PyEval_InitThreads", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyThreadState*, PyEval_SaveThread, (), "PyEval_SaveThread", "PyEval_SaveThread", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyEval_RestoreThread, (PyThreadState *tstate), "PyEval_RestoreThread", "PyEval_RestoreThread", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyThreadState*, PyThreadState_Swap, (PyThreadState *tstate), "PyThreadState_Swap", "PyThreadState_Swap", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyThreadState*, PyThreadState_Get, (), "PyThreadState_Get", "PyThreadState_Get", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyThreadState*, PyThreadState_New, (PyInterpreterState *interp), "PyThreadState_New", "PyThreadState_New", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyThreadState_Clear, (PyThreadState *tstate), "PyThreadState_Clear", "PyThreadState_Clear", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyThreadState_Delete, (PyThreadState *tstate), "PyThreadState_Delete", "PyThreadState_Delete", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyThreadState_SetAsyncExc, (unsigned long id, PyObject *exc), "PyThreadState_SetAsyncExc", "PyThreadState_SetAsyncExc", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyInterpreterState*, PyThreadState_GetInterpreter, (PyThreadState *tstate), NULL, "PyThreadState_GetInterpreter", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyImport_Import, (PyObject *name), "PyImport_Import", "PyImport_Import", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyImport_ImportModule, (const char *name), "PyImport_ImportModule", "PyImport_ImportModule", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyImport_AddModule, (const char *name), "PyImport_AddModule", "PyImport_AddModule", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, PyImport_Cleanup, (void), "PyImport_Cleanup", "PyImport_Cleanup", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyRun_String, (const char *str, int start, PyObject *globals, PyObject *locals), "PyRun_String", "PyRun_String", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, Py_CompileString, (const char *str, const char *filename, int start), "Py_CompileString", "Py_CompileString", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyEval_EvalCode, (PyObject *co, PyObject *globals, PyObject *locals), "PyEval_EvalCode", "PyEval_EvalCode", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyRun_SimpleString, (const char* str), "PyRun_SimpleString", "PyRun_SimpleString", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyDict_New, (), "PyDict_New", "PyDict_New", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyDict_SetItemString, (PyObject *p, const char *key, PyObject *val), "PyDict_SetItemString", "PyDict_SetItemString", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyDict_GetItemString, (PyObject *p, const char* key), "PyDict_GetItemString", "PyDict_GetItemString", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, PyDict_Clear, (PyObject *p), "PyDict_Clear", "PyDict_Clear", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyDict_Copy, (PyObject *p), "PyDict_Copy", "PyDict_Copy", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyObject_Call, (PyObject *callable_object, PyObject *args, PyObject *kw), "PyObject_Call", "PyObject_Call", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyObject_CallObject, (PyObject *callable_object, PyObject *args), "PyObject_CallObject", "PyObject_CallObject", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyObject_GetAttr, (PyObject *object, PyObject *attr_name), "PyObject_GetAttr", "PyObject_GetAttr", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyObject_GetAttrString, (PyObject *object, const char *attr_name), "PyObject_GetAttrString", "PyObject_GetAttrString", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyObject_SetAttr, (PyObject *object, PyObject *attr_name, PyObject *value), "PyObject_SetAttr", "PyObject_SetAttr", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(int, PyObject_SetAttrString, (PyObject *o, const char *attr_name, PyObject *v), "PyObject_SetAttrString", "PyObject_SetAttrString", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyObject_IsInstance, (PyObject *inst, PyObject *cls), "PyObject_IsInstance", "PyObject_IsInstance", PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyObject_Size, (PyObject *o), "PyObject_Size", "PyObject_Size", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyTuple_New, (size_t len), "PyTuple_New", "PyTuple_New", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyTuple_SetItem, (PyObject *p, size_t pos, PyObject *o), "PyTuple_SetItem", "PyTuple_SetItem", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyTuple_GetItem, (PyObject *p, size_t pos), "PyTuple_GetItem", "PyTuple_GetItem", PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyTuple_Size, (PyObject *p), "PyTuple_Size", "PyTuple_Size", PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyList_Size, (PyObject* list), "PyList_Size", "PyList_Size", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyList_GetItem, (PyObject *list, size_t index), "PyList_GetItem", "PyList_GetItem", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyList_Insert, (PyObject *list, size_t index, PyObject *item), "PyList_Insert", "PyList_Insert", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyCFunction_NewEx, (PyMethodDef *, PyObject *, PyObject *), "PyCFunction_NewEx", "PyCFunction_NewEx", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyDescr_NewMethod, (PyObject* type, struct PyMethodDef *meth), "PyDescr_NewMethod", "PyDescr_NewMethod", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyType_FromSpec, (PyType_Spec *spec), NULL, "PyType_FromSpec", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyType_GenericAlloc, (PyObject *type, size_t nitems), "PyType_GenericAlloc", "PyType_GenericAlloc", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void*, PyType_GetSlot, (PyObject *type, int slot), NULL, "PyType_GetSlot", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, PyObject_Free, (void *p), "PyObject_Free", "PyObject_Free", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyClass_New, (PyObject* className, PyObject* classBases, PyObject* classDict), "PyClass_New", NULL, PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyInstance_New, (PyObject *classobj, PyObject *arg, PyObject *kw), "PyInstance_New", NULL, PYAPI_OPTIONAL)
+PYTHON_API_FUNC(PyObject*, PyMethod_New, (PyObject *func, PyObject *self, PyObject *classobj), "PyMethod_New", "PyMethod_New", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyInstanceMethod_New, (PyObject *func), NULL, "PyInstanceMethod_New", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyCapsule_New, (void *pointer, const char *name, PyCapsule_Destructor destructor), "PyCapsule_New", "PyCapsule_New", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void*, PyCapsule_GetPointer, (PyObject *capsule, const char *name), "PyCapsule_GetPointer", "PyCapsule_GetPointer", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PySys_GetObject, (char *name), "PySys_GetObject", "PySys_GetObject", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PySys_SetObject, (char *name, PyObject *v), "PySys_SetObject", "PySys_SetObject", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PySys_SetArgv, (int argc, char **argv), "PySys_SetArgv", NULL, PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PySys_SetArgv_Py3, (int argc, wchar_t **argv), NULL, "PySys_SetArgv", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyString_FromString, (const char *v), "PyString_FromString", NULL, PYAPI_REQUIRED)
+PYTHON_API_FUNC(char*, PyString_AsString, (PyObject *string), "PyString_AsString", NULL, PYAPI_REQUIRED)
+PYTHON_API_FUNC(char*, PyBytes_AsString, (PyObject *bytes), NULL, "PyBytes_AsString", PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyString_Size, (PyObject *string), "PyString_Size", NULL, PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyBytes_Size, (PyObject *bytes), NULL, "PyBytes_Size", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyUnicode_FromString, (const char *u), NULL, "PyUnicode_FromString", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyUnicode_FromWideChar, (const wchar_t *w, size_t size), "PyUnicodeUCS2_FromWideChar", "PyUnicode_FromWideChar", PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyUnicode_AsWideChar, (PyObject *unicode, wchar_t *w, size_t size), "PyUnicodeUCS2_AsWideChar", "PyUnicode_AsWideChar", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyBool_FromLong, (long v), "PyBool_FromLong", "PyBool_FromLong", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyObject_IsTrue, (PyObject *o), "PyObject_IsTrue", "PyObject_IsTrue", PYAPI_REQUIRED)
+PYTHON_API_FUNC(long long, PyLong_AsLongLong, (PyObject *o), "PyLong_AsLongLong", "PyLong_AsLongLong", PYAPI_REQUIRED)
+PYTHON_API_FUNC(unsigned long long, PyLong_AsUnsignedLongLong, (PyObject *o), "PyLong_AsUnsignedLongLong", "PyLong_AsUnsignedLongLong", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyLong_FromLongLong, (long long v), "PyLong_FromLongLong", "PyLong_FromLongLong", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyLong_FromUnsignedLongLong, (unsigned long long v), "PyLong_FromUnsignedLongLong", "PyLong_FromUnsignedLongLong", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyString_FromStringAndSize, (const char *v, size_t len), "PyString_FromStringAndSize", NULL, PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyBytes_FromStringAndSize, (const char *v, size_t len), NULL, "PyBytes_FromStringAndSize", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyObject_GetBuffer, (PyObject *obj, Py_buffer *view, int flags), "PyObject_GetBuffer", "PyObject_GetBuffer", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyBuffer_Release, (Py_buffer *view), "PyBuffer_Release", "PyBuffer_Release", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyErr_Fetch, (PyObject **ptype, PyObject **pvalue, PyObject **ptraceback), "PyErr_Fetch", "PyErr_Fetch", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyErr_NormalizeException, (PyObject**exc, PyObject**val, PyObject**tb), "PyErr_NormalizeException", "PyErr_NormalizeException", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyErr_SetString, (PyObject *type, const char *message), "PyErr_SetString", "PyErr_SetString", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyErr_Clear, (), "PyErr_Clear", "PyErr_Clear", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyObject*, PyErr_Occurred, (), "PyErr_Occurred", "PyErr_Occurred", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, Py_AddPendingCall, (int(*func)(void *), void *arg), "Py_AddPendingCall", "Py_AddPendingCall", PYAPI_REQUIRED)
+PYTHON_API_FUNC(PyGILState_STATE, PyGILState_Ensure, (), "PyGILState_Ensure", "PyGILState_Ensure", PYAPI_REQUIRED)
+PYTHON_API_FUNC(void, PyGILState_Release, (PyGILState_STATE state), "PyGILState_Release", "PyGILState_Release", PYAPI_REQUIRED)
+PYTHON_API_FUNC(int, PyGILState_Check, (void), NULL, "PyGILState_Check", PYAPI_REQUIRED)
+PYTHON_API_FUNC(size_t, PyGC_Collect, (void), "PyGC_Collect", "PyGC_Collect", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, PyMem_GetAllocator, (int domain, PyMemAllocatorEx *allocator), NULL, "PyMem_GetAllocator", PYAPI_OPTIONAL)
+PYTHON_API_FUNC(void, PyMem_SetAllocator, (int domain, PyMemAllocatorEx *allocator), NULL, "PyMem_SetAllocator", PYAPI_OPTIONAL)
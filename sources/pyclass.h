@@ -1,11 +1,16 @@
 #pragma once
 
 #include "pyapi.h"
+#include "pyinterpret.h"
 
 
 #include <comutil.h>
 
+#include <limits>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 
@@ -17,230 +22,798 @@ public:
 };
 
 
-struct convert_from_python
-{
-    convert_from_python(PyObject* obj) : m_obj(obj){}
+//////////////////////////////////////////////////////////////////////////////
+//
+// String conversions instantiated for each major version: the binding layer
+// picks the instantiation when a class is built, so bound calls do not
+// check the interpreter version.
+//
+//////////////////////////////////////////////////////////////////////////////
 
-    operator std::wstring()
+template<bool Py3>
+struct PyText
+{
+    static std::wstring toWide(PyObject* obj)
     {
-        if ( PyUnicode_Check(m_obj) )
+        if ( PyUnicode_Check(obj) )
         {
-            std::vector<wchar_t>  buf(0x10000);
-            size_t  len = buf.size();
-            len = PyUnicode_AsWideChar(m_obj, &buf[0], len);
-            return std::wstring(&buf[0], len);
+            std::wstring  str(unicodeLength(obj), L'\0');
+            if (!str.empty())
+                str.resize(copyUnicode(obj, &str[0], str.size()));
+            return str;
         }
 
-        if (!IsPy3() )
+        const char*  bytes;
+        size_t  size;
+        if (getBytes(obj, bytes, size))
         {
-            if (PyString_Check(m_obj))
-            {
-                return std::wstring(_bstr_t(PyString_AsString(m_obj)));
-            }
+            std::wstring  str(MultiByteToWideChar(CP_ACP, 0, bytes, static_cast<int>(size), NULL, 0), L'\0');
+            if (!str.empty())
+                MultiByteToWideChar(CP_ACP, 0, bytes, static_cast<int>(size), &str[0], static_cast<int>(str.size()));
+            return str;
         }
-        else
+
+        throw convert_python_exception("failed convert argument");
+    }
+
+    static std::string toString(PyObject* obj)
+    {
+        if (PyUnicode_Check(obj))
         {
-            if (PyBytes_Check(m_obj))
-            {
-                return std::wstring(_bstr_t(PyBytes_AsString(m_obj)));
-            }
+            std::vector<wchar_t>&  wide = scratchBuffer();
+
+            size_t  length = unicodeLength(obj);
+            if (length == 0)
+                return std::string();
+
+            if (wide.size() < length)
+                wide.resize(length);
+
+            int  wideLength = static_cast<int>(copyUnicode(obj, &wide[0], length));
+            if (wideLength == 0)
+                return std::string();
+
+            std::string  str(WideCharToMultiByte(CP_ACP, 0, &wide[0], wideLength, NULL, 0, NULL, NULL), '\0');
+            if (!str.empty())
+                WideCharToMultiByte(CP_ACP, 0, &wide[0], wideLength, &str[0], static_cast<int>(str.size()), NULL, NULL);
+            return str;
         }
 
+        const char*  bytes;
+        size_t  size;
+        if (getBytes(obj, bytes, size))
+            return std::string(bytes, size);
+
         throw convert_python_exception("failed convert argument");
     }
 
+    static PyObject* fromBytes(const char* data, size_t size)
+    {
+        return Py3 ? PyBytes_FromStringAndSize(data, size) : PyString_FromStringAndSize(data, size);
+    }
 
-    operator std::string()
+private:
+
+    // number of wchar_t in the string without the terminating zero
+    static size_t unicodeLength(PyObject* obj)
     {
-        if (PyUnicode_Check(m_obj))
+        size_t  length;
+
+        if (Py3)
         {
-            std::vector<wchar_t>  buf(0x10000);
-            size_t  len = buf.size();
-            len = PyUnicode_AsWideChar(m_obj, &buf[0], len);
-            std::wstring  str(&buf[0], len);
-            return std::string(_bstr_t(str.c_str()));
+            // python 3 returns the required buffer size with the terminating zero
+            length = PyUnicode_AsWideChar(obj, NULL, 0);
+            length = length != static_cast<size_t>(-1) && length > 0 ? length - 1 : 0;
         }
+        else
+        {
+            // python 2 for windows keeps unicode as UTF-16
+            length = PyObject_Size(obj);
+            length = length != static_cast<size_t>(-1) ? length : 0;
+        }
+
+        return length;
+    }
 
-        if (!IsPy3())
+    static size_t copyUnicode(PyObject* obj, wchar_t* buffer, size_t length)
+    {
+        size_t  copied = PyUnicode_AsWideChar(obj, buffer, length);
+        return copied != static_cast<size_t>(-1) ? copied : 0;
+    }
+
+    static bool getBytes(PyObject* obj, const char*& bytes, size_t& size)
+    {
+        if (!Py3)
         {
-            if (PyString_Check(m_obj))
-            {
-                return std::string(PyString_AsString(m_obj));
-            }
+            if (!PyString_Check(obj))
+                return false;
+
+            bytes = PyString_AsString(obj);
+            size = PyString_Size(obj);
         }
         else
         {
-            if (PyBytes_Check(m_obj))
-            {
-                return std::string(PyBytes_AsString(m_obj));
-            }
+            if (!PyBytes_Check(obj))
+                return false;
+
+            bytes = PyBytes_AsString(obj);
+            size = PyBytes_Size(obj);
         }
 
-        throw convert_python_exception("failed convert argument");
+        return bytes != NULL && size != static_cast<size_t>(-1);
+    }
+
+    // reusable per thread buffer for the intermediate UTF-16 text
+    static std::vector<wchar_t>& scratchBuffer()
+    {
+        thread_local std::vector<wchar_t>  buffer;
+        return buffer;
+    }
+};
+
+// conversion for code which does not know the interpreter version
+struct convert_from_python
+{
+    convert_from_python(PyObject* obj) : m_obj(obj){}
+
+    operator std::wstring()
+    {
+        return IsPy3() ? PyText<true>::toWide(m_obj) : PyText<false>::toWide(m_obj);
+    }
+
+    operator std::string()
+    {
+        return IsPy3() ? PyText<true>::toString(m_obj) : PyText<false>::toString(m_obj);
     }
 
     PyObject* m_obj;
 };
 
-struct convert_to_python
+//////////////////////////////////////////////////////////////////////////////
+//
+// Conversions of bound method arguments and results, selected at compile
+// time by the C++ type ( without cv and reference ) and the major version.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+template<typename T, bool Py3, typename Enable = void>
+struct PyConvert;
+
+template<bool Py3>
+struct PyConvert<std::wstring, Py3>
+{
+    static std::wstring from(PyObject* obj) {
+        return PyText<Py3>::toWide(obj);
+    }
+
+    static PyObject* to(const std::wstring& v) {
+        return PyUnicode_FromWideChar(v.c_str(), v.size());
+    }
+};
+
+template<bool Py3>
+struct PyConvert<std::string, Py3>
 {
-    operator PyObject* (){
-        return m_obj;
+    static std::string from(PyObject* obj) {
+        return PyText<Py3>::toString(obj);
     }
 
-    convert_to_python()
+    static PyObject* to(const std::string& v)
+    {
+        std::wstring  str(MultiByteToWideChar(CP_ACP, 0, v.c_str(), static_cast<int>(v.size()), NULL, 0), L'\0');
+        if (!str.empty())
+            MultiByteToWideChar(CP_ACP, 0, v.c_str(), static_cast<int>(v.size()), &str[0], static_cast<int>(str.size()));
+        return PyConvert<std::wstring, Py3>::to(str);
+    }
+};
+
+template<bool Py3>
+struct PyConvert<bool, Py3>
+{
+    static bool from(PyObject* obj)
     {
+        int  res = PyObject_IsTrue(obj);
+        if (res < 0)
+            throw convert_python_exception("failed convert argument");
+        return res != 0;
+    }
 
+    static PyObject* to(bool v) {
+        return PyBool_FromLong(v ? 1 : 0);
     }
+};
 
-    convert_to_python(const std::wstring& str)
+template<typename T, bool Py3>
+struct PyConvert<T, Py3, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type>
+{
+    static T from(PyObject* obj)
     {
-        m_obj = PyUnicode_FromWideChar(str.c_str(), str.size());
+        long long  v = PyLong_AsLongLong(obj);
+        if (v == -1 && PyErr_Occurred())
+            throw convert_python_exception("integer argument expected");
+
+        if (v < (std::numeric_limits<T>::min)() || v > (std::numeric_limits<T>::max)())
+            throw convert_python_exception("integer argument out of range");
+
+        return static_cast<T>(v);
     }
 
-    convert_to_python(bool v)
+    static PyObject* to(T v) {
+        return PyLong_FromLongLong(v);
+    }
+};
+
+// unsigned integers and 64-bit addresses
+template<typename T, bool Py3>
+struct PyConvert<T, Py3, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value>::type>
+{
+    static T from(PyObject* obj)
     {
-        m_obj = PyBool_FromLong(v == true ? 1 : 0);
-    }    
+        unsigned long long  v = PyLong_AsUnsignedLongLong(obj);
 
-    PyObject* m_obj;
+        if (v == static_cast<unsigned long long>(-1) && PyErr_Occurred())
+        {
+            // python 2 does not take int objects here
+            if (Py3)
+                throw convert_python_exception("integer argument expected");
+
+            PyErr_Clear();
+
+            long long  sv = PyLong_AsLongLong(obj);
+            if ((sv == -1 && PyErr_Occurred()) || sv < 0)
+                throw convert_python_exception("unsigned integer argument expected");
+
+            v = static_cast<unsigned long long>(sv);
+        }
+
+        if (v > (std::numeric_limits<T>::max)())
+            throw convert_python_exception("integer argument out of range");
+
+        return static_cast<T>(v);
+    }
+
+    static PyObject* to(T v) {
+        return PyLong_FromUnsignedLongLong(v);
+    }
+};
+
+// the borrowed argument as is, a result is a new reference
+template<bool Py3>
+struct PyConvert<PyObject*, Py3>
+{
+    static PyObject* from(PyObject* obj) {
+        return obj;
+    }
+
+    static PyObject* to(PyObject* v) {
+        return v;
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+// contiguous data of an object with the buffer protocol ( bytes, bytearray,
+// memoryview, array ), released after the call
+class PyBufferView
+{
+public:
+
+    explicit PyBufferView(PyObject* obj)
+    {
+        if (PyObject_GetBuffer(obj, &m_view, PyBUF_SIMPLE) != 0)
+            throw convert_python_exception("bytes-like object expected");
+    }
+
+    ~PyBufferView()
+    {
+        PyBuffer_Release(&m_view);
+    }
+
+    const void* data() const {
+        return m_view.buf;
+    }
+
+    size_t size() const {
+        return m_view.len;
+    }
+
+private:
+
+    PyBufferView(const PyBufferView&) = delete;
+    PyBufferView& operator= (const PyBufferView&) = delete;
+
+    Py_buffer  m_view;
 };
 
+typedef std::vector<unsigned char>  PyBytes;
 
+template<bool Py3>
+struct PyConvert<PyBytes, Py3>
+{
+    static PyBytes from(PyObject* obj)
+    {
+        PyBufferView  view(obj);
+        const unsigned char*  data = static_cast<const unsigned char*>(view.data());
+        return PyBytes(data, data + view.size());
+    }
+
+    static PyObject* to(const PyBytes& v)
+    {
+        const char*  data = v.empty() ? "" : reinterpret_cast<const char*>(&v[0]);
+        return PyText<Py3>::fromBytes(data, v.size());
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+// converted argument, built in place for the duration of the call
+template<typename T, bool Py3>
+struct PyArg
+{
+    explicit PyArg(PyObject* obj) : m_value(PyConvert<T, Py3>::from(obj))
+    {}
+
+    T& get() {
+        return m_value;
+    }
+
+    T  m_value;
+};
+
+template<bool Py3>
+struct PyArg<PyBufferView, Py3>
+{
+    explicit PyArg(PyObject* obj) : m_view(obj)
+    {}
+
+    PyBufferView& get() {
+        return m_view;
+    }
+
+    PyBufferView  m_view;
+};
+
+template<typename R, bool Py3>
+struct PyResult
+{
+    template<typename Fn>
+    static PyObject* call(Fn fn) {
+        return PyConvert<typename std::decay<R>::type, Py3>::to(fn());
+    }
+};
+
+template<bool Py3>
+struct PyResult<void, Py3>
+{
+    template<typename Fn>
+    static PyObject* call(Fn fn)
+    {
+        fn();
+        Py_IncRef(Py_None());
+        return Py_None();
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Binding of C++ classes. On python 3 a class is a heap type created by
+// PyType_FromSpec and its instances keep the C++ object pointer right after
+// the object header, so a method gets "this" with one pointer load. Python 2
+// classes are built with type(name, (), {}) and keep the C++ object in a
+// "cppobject" capsule attribute.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+struct PyCppObject {
+    size_t  ob_refcnt;
+    PyObject*  ob_type;
+    void*  cppobj;
+};
+
+template<typename T1, bool Py3>
+T1*  get_cppobject(PyObject* obj)
+{
+    if (Py3)
+        return static_cast<T1*>(reinterpret_cast<PyCppObject*>(obj)->cppobj);
+
+    PyObject*  cppobj = PyObject_GetAttrString(obj, "cppobject");
+    if (!cppobj)
+    {
+        PyErr_Clear();
+        return NULL;
+    }
+
+    T1*  t1 = reinterpret_cast<T1*>(PyCapsule_GetPointer(cppobj, "cppobject"));
+    Py_DecRef(cppobj);
+    return t1;
+}
+
+template<typename T1>
+T1*  get_cppobject(PyObject* obj)
+{
+    return IsPy3() ? get_cppobject<T1, true>(obj) : get_cppobject<T1, false>(obj);
+}
+
+template<typename T1>
+void delete_pyobject(PyObject* obj)
+{
+    T1*  cppobj = reinterpret_cast<T1*>(PyCapsule_GetPointer(obj, "cppobject"));
+    delete cppobj;
+}
+
+template<typename T1>
+void dealloc_pyobject(PyObject* obj)
+{
+    PyCppObject*  pyobj = reinterpret_cast<PyCppObject*>(obj);
+    PyObject*  type = pyobj->ob_type;
+
+    delete static_cast<T1*>(pyobj->cppobj);
+
+    freefunc  tp_free = reinterpret_cast<freefunc>(PyType_GetSlot(type, Py_tp_free));
+    if (tp_free)
+        tp_free(obj);
+    else
+        PyObject_Free(obj);
+
+    // instances of heap types own a reference to the type
+    Py_DecRef(type);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Entry points of a bound method for every calling convention: python 2
+// passes self in the args tuple, python 3 passes it separately and takes
+// METH_NOARGS / METH_O for methods with no or one argument and, since 3.7,
+// METH_FASTCALL for the others, so no args tuple is built for the call.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+template<typename Caller, typename T, typename R, typename... Args>
+struct PyMethodThunkImpl
+{
+    static const size_t  arity = sizeof...(Args);
+
+    template<bool Py3>
+    static PyObject* invoke(PyObject* self, PyObject* const* argv)
+    {
+        try {
+            // an instance created from python is not bound to a C++ object
+            T*  _this = self ? get_cppobject<T, Py3>(self) : NULL;
+            if (!_this)
+            {
+                PyErr_SetString(PyExc_TypeError(), "object is not bound to a C++ object");
+                return NULL;
+            }
+
+            return call<Py3>(_this, argv, std::index_sequence_for<Args...>());
+        }
+        catch (convert_python_exception& exc)
+        {
+            if (!PyErr_Occurred())
+                PyErr_SetString(PyExc_TypeError(), exc.what());
+        }
+        return NULL;
+    }
+
+    template<bool Py3, size_t... I>
+    static PyObject* call(T* _this, PyObject* const* argv, std::index_sequence<I...>)
+    {
+        std::tuple<PyArg<typename std::decay<Args>::type, Py3>...>  args(argv[I]...);
+        return PyResult<R, Py3>::call([&]() -> R { return Caller::call(_this, std::get<I>(args).get()...); });
+    }
+
+    template<bool Py3>
+    static PyObject* varargs(PyObject* self, PyObject* args)
+    {
+        size_t  offset = 0;
+
+        if (!Py3)
+        {
+            self = PyTuple_GetItem(args, 0);
+            offset = 1;
+        }
+
+        if (PyTuple_Size(args) != arity + offset)
+            return argumentCountError();
+
+        PyObject*  argv[arity + 1];
+        for (size_t i = 0; i < arity; ++i)
+            argv[i] = PyTuple_GetItem(args, i + offset);
+
+        return invoke<Py3>(self, argv);
+    }
+
+    // the entry points below are python 3 only
+
+    static PyObject* noargs(PyObject* self, PyObject*)
+    {
+        return invoke<true>(self, NULL);
+    }
+
+    static PyObject* onearg(PyObject* self, PyObject* arg)
+    {
+        return invoke<true>(self, &arg);
+    }
+
+    static PyObject* fastcall(PyObject* self, PyObject* const* args, size_t nargs)
+    {
+        if (nargs != arity)
+            return argumentCountError();
+
+        return invoke<true>(self, args);
+    }
+
+    static PyObject* getter(PyObject* self, void*)
+    {
+        return invoke<true>(self, NULL);
+    }
+
+    static PyObject* argumentCountError()
+    {
+        PyErr_SetString(PyExc_TypeError(), "wrong number of arguments");
+        return NULL;
+    }
+};
+
+template<typename T, typename F, F method>
+struct PyMethodThunk;
+
+template<typename T, typename C, typename R, typename... Args, R (C::*method)(Args...)>
+struct PyMethodThunk<T, R (C::*)(Args...), method> :
+    PyMethodThunkImpl<PyMethodThunk<T, R (C::*)(Args...), method>, T, R, Args...>
+{
+    template<typename... A>
+    static R call(T* _this, A&... args) {
+        return (_this->*method)(args...);
+    }
+};
+
+template<typename T, typename C, typename R, typename... Args, R (C::*method)(Args...) const>
+struct PyMethodThunk<T, R (C::*)(Args...) const, method> :
+    PyMethodThunkImpl<PyMethodThunk<T, R (C::*)(Args...) const, method>, T, R, Args...>
+{
+    template<typename... A>
+    static R call(T* _this, A&... args) {
+        return (_this->*method)(args...);
+    }
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+enum PyCallConvention {
+    PyCallConvention_Py2,       // METH_VARARGS, self in args
+    PyCallConvention_Py3,       // METH_NOARGS, METH_O, METH_VARARGS
+    PyCallConvention_Py37,      // METH_NOARGS, METH_O, METH_FASTCALL
+    PyCallConventionCount
+};
+
+inline PyCallConvention getCallConvention()
+{
+    if (!IsPy3())
+        return PyCallConvention_Py2;
+
+    return PyMinorVersion() >= 7 ? PyCallConvention_Py37 : PyCallConvention_Py3;
+}
+
+// method and property tables of a bound class: filled by the first build
+// and shared by all interpreters ( python 3 types keep pointers to them )
+struct PyClassDefs
+{
+    PyClassDefs() : complete(false)
+    {}
+
+    std::vector<PyMethodDef>  methods[PyCallConventionCount];
+    std::vector<PyGetSetDef>  properties;
+    std::vector<PyMethodDef>  getters;  // python 2 property getters
+    bool  complete;
+};
+
+class PyClassBuilder
+{
+public:
+
+    PyClassBuilder(const char* className, PyClassDefs& defs, destructor dealloc) :
+        m_className(className),
+        m_defs(defs),
+        m_dealloc(dealloc)
+    {}
+
+    template<typename Thunk>
+    void addMethod(const char* name, const char* doc)
+    {
+        if (m_defs.complete)
+            return;
+
+        PyMethodDef  py2Def = { name, &Thunk::template varargs<false>, METH_VARARGS, doc };
+        m_defs.methods[PyCallConvention_Py2].push_back(py2Def);
+
+        PyMethodDef  py3Def = { name, &Thunk::template varargs<true>, METH_VARARGS, doc };
+        if (Thunk::arity == 0)
+        {
+            py3Def.ml_meth = Thunk::noargs;
+            py3Def.ml_flags = METH_NOARGS;
+        }
+        else if (Thunk::arity == 1)
+        {
+            py3Def.ml_meth = Thunk::onearg;
+            py3Def.ml_flags = METH_O;
+        }
+        m_defs.methods[PyCallConvention_Py3].push_back(py3Def);
+
+        if (py3Def.ml_flags == METH_VARARGS)
+        {
+            py3Def.ml_meth = reinterpret_cast<PyCFunction>(static_cast<PyCFunctionFast>(Thunk::fastcall));
+            py3Def.ml_flags = METH_FASTCALL;
+        }
+        m_defs.methods[PyCallConvention_Py37].push_back(py3Def);
+    }
+
+    template<typename Thunk>
+    void addProperty(const char* name, const char* doc)
+    {
+        static_assert(Thunk::arity == 0, "property getter takes no arguments");
+
+        if (m_defs.complete)
+            return;
+
+        PyGetSetDef  prop = { name, Thunk::getter, NULL, doc, NULL };
+        m_defs.properties.push_back(prop);
+
+        PyMethodDef  def = { name, &Thunk::template varargs<false>, METH_VARARGS, doc };
+        m_defs.getters.push_back(def);
+    }
+
+    PyObject* create()
+    {
+        if (!m_defs.complete)
+        {
+            PyMethodDef  methodEnd = { NULL, NULL, 0, NULL };
+            for (auto& methods : m_defs.methods)
+                methods.push_back(methodEnd);
+
+            PyGetSetDef  propertyEnd = { NULL, NULL, NULL, NULL, NULL };
+            m_defs.properties.push_back(propertyEnd);
+
+            m_defs.complete = true;
+        }
+
+        PyCallConvention  callConvention = getCallConvention();
+
+        return callConvention == PyCallConvention_Py2 ? createClass() : createType(m_defs.methods[callConvention]);
+    }
+
+private:
+
+    // instances are made by make_pyobject only: a NULL tp_new would be inherited
+    // from object before python 3.10, so the slot refuses the call instead
+    static PyObject* newInstance(PyObject*, PyObject*, PyObject*)
+    {
+        PyErr_SetString(PyExc_TypeError(), "cannot create instances of a bound C++ class");
+        return NULL;
+    }
+
+    PyObject* createType(std::vector<PyMethodDef>& methods)
+    {
+        PyType_Slot  slots[] = {
+            { Py_tp_dealloc, reinterpret_cast<void*>(m_dealloc) },
+            { Py_tp_new, reinterpret_cast<void*>(static_cast<newfunc>(newInstance)) },
+            { Py_tp_methods, &methods[0] },
+            { Py_tp_getset, &m_defs.properties[0] },
+            { 0, NULL }
+        };
+
+        PyType_Spec  spec = { m_className, sizeof(PyCppObject), 0, Py_TPFLAGS_DEFAULT, slots };
+
+        return PyType_FromSpec(&spec);
+    }
+
+    PyObject* createClass()
+    {
+        PyObject*  args = PyTuple_New(3);
+        PyTuple_SetItem(args, 0, PyString_FromString(m_className));
+        PyTuple_SetItem(args, 1, PyTuple_New(0));
+        PyTuple_SetItem(args, 2, PyDict_New());
+        PyObject*  classTypeObj = PyObject_CallObject(PyType_Type(), args);
+        Py_DecRef(args);
+
+        for (PyMethodDef* def = &m_defs.methods[PyCallConvention_Py2][0]; def->ml_name; ++def)
+        {
+            PyObject*  cFuncObj = PyCFunction_NewEx(def, NULL, NULL);
+            PyObject*  methodObj = PyMethod_New(cFuncObj, NULL, classTypeObj);
+            PyObject_SetAttrString(classTypeObj, def->ml_name, methodObj);
+            Py_DecRef(cFuncObj), Py_DecRef(methodObj);
+        }
+
+        for (PyMethodDef& def : m_defs.getters)
+        {
+            PyObject*  cFuncObj = PyCFunction_NewEx(&def, NULL, NULL);
+            PyObject*  methodObj = PyMethod_New(cFuncObj, NULL, classTypeObj);
+            PyObject*  args = PyTuple_New(4);
+            PyTuple_SetItem(args, 0, methodObj);
+            Py_IncRef(Py_None());
+            PyTuple_SetItem(args, 1, Py_None());
+            Py_IncRef(Py_None());
+            PyTuple_SetItem(args, 2, Py_None());
+            PyTuple_SetItem(args, 3, PyString_FromString(def.ml_doc));
+            PyObject*  propertyObj = PyObject_CallObject(PyProperty_Type(), args);
+            PyObject_SetAttrString(classTypeObj, def.ml_name, propertyObj);
+            Py_DecRef(cFuncObj), Py_DecRef(propertyObj), Py_DecRef(args);
+        }
+
+        return classTypeObj;
+    }
+
+    const char*  m_className;
+    PyClassDefs&  m_defs;
+    destructor  m_dealloc;
+};
+
+//////////////////////////////////////////////////////////////////////////////
 
 #define BEGIN_PYTHON_METHOD_MAP(classType, className) \
-    template <typename TRet> \
-    PyObject* callMethod0( \
-        TRet (classType::*method)()) \
-      { \
-          TRet r = (this->*method)(); \
-          return convert_to_python(r); \
-      } \
-    PyObject* callMethod0(\
-        void (classType::*method)()) \
-    { \
-        (this->*method)(); \
-        Py_IncRef(Py_None()); \
-        return Py_None(); \
-    } \
-    template <typename TRet, typename V1> \
-    PyObject* callMethod1( \
-        TRet (classType::*method)(V1& v1), \
-        convert_from_python& v1)\
-      { \
-          return (this->*method)(v1); \
-      } \
-    template <typename V1> \
-    PyObject* callMethod1(\
-      void(classType::*method)(V1& v1), \
-      convert_from_python& v1)\
-    { \
-      (this->*method)(v1); \
-      Py_IncRef(Py_None()); \
-      return Py_None(); \
+static const char* getPythonClassName() { \
+        return className; \
     } \
 template<typename T = classType> \
 static PyObject* getPythonClass() { \
-        PyObject*  args = PyTuple_New(3); \
-        PyTuple_SetItem(args, 0, IsPy3() ? PyUnicode_FromString(className) : PyString_FromString(className)); \
-        PyTuple_SetItem(args, 1, PyTuple_New(0)); \
-        PyTuple_SetItem(args, 2, PyDict_New()); \
-        PyObject*  classTypeObj = PyObject_CallObject(PyType_Type(), args); \
-        Py_DecRef(args);
+        static PyClassDefs  classDefs; \
+        PyClassBuilder  builder(className, classDefs, dealloc_pyobject<T>);
 
 #define END_PYTHON_METHOD_MAP  \
-        return classTypeObj; \
-    }
-
-#define PYTHON_METHOD0(name, fn, doc) \
-    struct Call_##fn { \
-        static PyObject* pycall(PyObject *s, PyObject *args) \
-         { \
-            try { \
-                PyObject*  self = PyTuple_GetItem(args, 0); \
-                PyObject*  cppobj =  PyObject_GetAttrString(self, "cppobject"); \
-                T*  _this = reinterpret_cast<T*>(PyCapsule_GetPointer(cppobj, "cppobject")); \
-                Py_DecRef(cppobj); \
-                return _this->callMethod0(&fn); \
-            } \
-            catch(convert_python_exception& exc) \
-            { PyErr_SetString(PyExc_TypeError(), exc.what()); } \
-            return Py_None(); \
-        } \
-    };  \
-    {\
-    static PyMethodDef methodDef = { name, Call_##fn::pycall, METH_VARARGS }; \
-    PyObject*  cFuncObj = PyCFunction_NewEx(&methodDef, NULL, NULL); \
-    PyObject*  methodObj = IsPy3() ? PyInstanceMethod_New(cFuncObj) : PyMethod_New(cFuncObj, NULL, classTypeObj); \
-    PyObject_SetAttrString(classTypeObj, name, methodObj); \
-    Py_DecRef(cFuncObj), Py_DecRef(methodObj); \
-    }
-
-#define PYTHON_METHOD1(name, fn, doc) \
-    struct Call_##fn { \
-        static PyObject* pycall(PyObject *s, PyObject *args) \
-        { \
-            PyObject*  self = PyTuple_GetItem(args, 0); \
-            PyObject*  cppobj =  PyObject_GetAttrString(self, "cppobject"); \
-            T*  _this = reinterpret_cast<T*>(PyCapsule_GetPointer(cppobj, "cppobject")); \
-            Py_DecRef(cppobj); \
-            PyObject* v1 = PyTuple_GetItem(args, 1); \
-            return _this->callMethod1(&fn, convert_from_python(v1)); \
-        } \
-    };  \
-    {\
-    static PyMethodDef methodDef = { name, Call_##fn::pycall, METH_VARARGS }; \
-    PyObject*  cFuncObj = PyCFunction_NewEx(&methodDef, NULL, NULL); \
-    PyObject*  methodObj = IsPy3() ? PyInstanceMethod_New(cFuncObj) : PyMethod_New(cFuncObj, NULL, classTypeObj); \
-    PyObject_SetAttrString(classTypeObj, name, methodObj); \
-    Py_DecRef(cFuncObj), Py_DecRef(methodObj); \
+        return builder.create(); \
     }
 
-#define PYTHON_PROPERTY(name, fn, doc) \
-    struct Call_##fn{ \
-            static PyObject* pycall(PyObject *s, PyObject *args) \
-             { \
-                PyObject*  self = PyTuple_GetItem(args, 0); \
-                PyObject*  cppobj =  PyObject_GetAttrString(self, "cppobject"); \
-                T*  _this = reinterpret_cast<T*>(PyCapsule_GetPointer(cppobj, "cppobject")); \
-                Py_DecRef(cppobj); \
-                return _this->callMethod0(&fn); \
-            } \
-        };  \
-        {\
-        static PyMethodDef methodDef = { name, Call_##fn::pycall, METH_VARARGS }; \
-        PyObject*  cFuncObj = PyCFunction_NewEx(&methodDef, NULL, NULL); \
-        PyObject*  methodObj = IsPy3() ? PyInstanceMethod_New(cFuncObj) : PyMethod_New(cFuncObj, NULL, classTypeObj); \
-        PyObject*  args = PyTuple_New(4); \
-        Py_IncRef(PyProperty_Type()); \
-        PyTuple_SetItem(args, 0, methodObj); \
-        Py_IncRef(Py_None()); \
-        PyTuple_SetItem(args, 1, Py_None()); \
-        Py_IncRef(Py_None()); \
-        PyTuple_SetItem(args, 2, Py_None()); \
-        PyTuple_SetItem(args, 3, IsPy3() ? PyUnicode_FromString(doc) : PyString_FromString(doc));\
-        PyObject*  propertyObj = PyObject_CallObject(PyProperty_Type(), args); \
-        PyObject_SetAttrString(classTypeObj, name, propertyObj); \
-        Py_DecRef(cFuncObj), Py_DecRef(propertyObj), Py_DecRef(args); \
-        }
+// any number of arguments of the types PyConvert knows, PyBufferView and PyObject*
+#define PYTHON_METHOD(name, fn, doc) \
+    builder.addMethod<PyMethodThunk<T, decltype(&T::fn), &T::fn>>(name, doc);
 
+#define PYTHON_METHOD0(name, fn, doc) PYTHON_METHOD(name, fn, doc)
 
+#define PYTHON_METHOD1(name, fn, doc) PYTHON_METHOD(name, fn, doc)
 
+#define PYTHON_PROPERTY(name, fn, doc) \
+    builder.addProperty<PyMethodThunk<T, decltype(&T::fn), &T::fn>>(name, doc);
+
+//////////////////////////////////////////////////////////////////////////////
+
+// the class object is built once per interpreter and kept until it ends
 template<typename T1>
-void delete_pyobject(PyObject* obj)
+PyObject*  get_pyclass()
 {
-    T1*  cppobj = reinterpret_cast<T1*>(PyCapsule_GetPointer(obj, "cppobject"));
-    delete cppobj;
+    std::string  key = std::string("class.") + T1::getPythonClassName();
+
+    PyObject*  cls = getInterpreterObject(key);
+    if (cls)
+    {
+        Py_IncRef(cls);
+        return cls;
+    }
+
+    cls = T1::getPythonClass();
+    if (cls)
+        setInterpreterObject(key, cls);
+
+    return cls;
 }
 
 template<typename T1, typename T2>
 PyObject*  make_pyobject(const T2& var)
 {
-    PyObject* cls = T1::getPythonClass();
+    PyObject* cls = get_pyclass<T1>();
+
+    T1*  t1 = new T1(var);
+
+    if (IsPy3())
+    {
+        PyObject*  p1 = PyType_GenericAlloc(cls, 0);
+        reinterpret_cast<PyCppObject*>(p1)->cppobj = t1;
+        Py_DecRef(cls);
+        return p1;
+    }
+
     PyObject* p1 = PyObject_CallObject(cls, NULL);
     Py_DecRef(cls);
 
-    T1*  t1 = new T1(var);
     PyObject*  p2 = PyCapsule_New(t1, "cppobject", delete_pyobject<T1>);
 
     PyObject_SetAttrString(p1, "cppobject", p2);
@@ -250,5 +823,23 @@ PyObject*  make_pyobject(const T2& var)
     return p1;
 }
 
+// an instance kept by the interpreter under the key, created on the first use
+// and rebound to the new value on the next ones
+template<typename T1, typename T2>
+PyObject*  get_resident_pyobject(const std::string& key, const T2& var)
+{
+    PyObject*  obj = getInterpreterObject(key);
+    T1*  cppobj = obj ? get_cppobject<T1>(obj) : NULL;
 
+    if (cppobj)
+    {
+        cppobj->bind(var);
+        Py_IncRef(obj);
+        return obj;
+    }
+
+    obj = make_pyobject<T1>(var);
+    setInterpreterObject(key, obj);
+    return obj;
+}
 
@@ -4,13 +4,26 @@
 #include <memory>
 #include <sstream>
 #include <map>
+#include <list>
 #include <set>
 #include <algorithm>
 #include <iterator>
+#include <bitset>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <stdexcept>
 
 #include "pymodule.h"
 #include "pyclass.h"
 #include "dbgout.h"
+#include "perftimer.h"
+#include "manifest.h"
+#include "arena.h"
+#include "mappedfile.h"
+#include "exportmerge.h"
 
 class PyModule;
 class PythonInterpreter;
@@ -45,7 +58,7 @@ private:
 };
 
 
-class PyModule
+class PyModule : public PyApiTable
 {
 public:
 
@@ -54,96 +67,112 @@ public:
     ~PyModule();
 
     bool isPy3;
+    int majorVersion;
+    int minorVersion;
+    PyRefcountMode refcountMode;
 
     void checkPykd();
     void deactivate();
+    ObjectArena* getArena();
 
-    PyObject* PyType_Type;
-    PyObject* PyProperty_Type;
-    PyObject* Py_None;
-    PyObject* PyExc_SystemExit;
-    PyObject* PyExc_TypeError;
-    PyObject* PyUnicode_Type;
-    PyObject* PyString_Type;
-    PyObject* PyBytes_Type;
-
-    PyThreadState**  PyThreadState_Current;
-
-    void( *Py_Initialize)();
-    void( *Py_Finalize)();
-
-    PyThreadState* ( *Py_NewInterpreter)();
-    void( *Py_EndInterpreter)(PyThreadState *tstate);
-    PyObject* ( *PyEval_GetGlobals)();
-    PyObject* ( *PyImport_Import)(PyObject *name);
-    PyObject* ( *PyImport_ImportModule)(const char *name);
-    void( *PyEval_InitThreads)();
-    PyThreadState* ( *PyEval_SaveThread)();
-    void( *PyEval_RestoreThread)(PyThreadState *tstate);
-    PyThreadState* ( *PyThreadState_Swap)(PyThreadState *tstate);
-    PyObject* ( *PyRun_String)(const char *str, int start, PyObject *globals, PyObject *locals);
-    int( *PyRun_SimpleString)(const char*  str);
-    PyObject* ( *PyRun_File)(FILE *fp, const char *filename, int start, PyObject *globals, PyObject *locals);
-    PyObject* ( *PyRun_FileExFlags)(FILE *fp, const char *filename, int start, PyObject *globals, PyObject *locals, int closeit, void *flags);
-    PyObject* ( *PyDict_New)();
-    int( *PyDict_SetItemString)(PyObject *p, const char *key, PyObject *val);
-    PyObject*( *PyDict_GetItemString)(PyObject *p, const char* key);
-    void ( *PyDict_Clear)(PyObject *p);
-    void( *Py_IncRef)(PyObject* object);
-    void( *Py_DecRef)(PyObject* object);
-    PyObject* ( *PyObject_Call)(PyObject *callable_object, PyObject *args, PyObject *kw);
-    PyObject* ( *PyObject_GetAttr)(PyObject *object, PyObject *attr_name);
-    PyObject* ( *PyObject_GetAttrString)(PyObject *object, const char *attr_name);
-    int( *PyObject_SetAttr)(PyObject *object, PyObject *attr_name, PyObject *value);
-    PyObject* ( *PyObject_CallObject)(PyObject *callable_object, PyObject *args);
-    PyObject* ( *PyTuple_New)(size_t len);
-    int( *PyTuple_SetItem)(PyObject *p, size_t pos, PyObject *o);
-    PyObject* ( *PyTuple_GetItem)(PyObject *p, size_t pos);
-    size_t( *PyTuple_Size)(PyObject *p);
-    PyObject* ( *PyCFunction_NewEx)(PyMethodDef *, PyObject *, PyObject *);
-    PyObject* ( *PySys_GetObject)(char *name);
-    int( *PySys_SetObject)(char *name, PyObject *v);
-    void( *PySys_SetArgv)(int argc, char **argv);
-    void( *PySys_SetArgv_Py3)(int argc, wchar_t **argv);
-    PyObject* ( *PyString_FromString)(const char *v);
-    char* ( *PyString_AsString)(PyObject *string);
-    char* ( *PyBytes_AsString)(PyObject *bytes);
-    void( *PyErr_Fetch)(PyObject **ptype, PyObject **pvalue, PyObject **ptraceback);
-    void( *PyErr_NormalizeException)(PyObject**exc, PyObject**val, PyObject**tb);
-    void( *PyErr_SetString)(PyObject *type, const char *message);
-    void( *PyErr_Clear)();
-    PyObject* ( *PyImport_AddModule)(const char *name);
-    PyObject* ( *PyClass_New)(PyObject* className, PyObject* classBases, PyObject* classDict);
-    PyObject* ( *PyInstance_New)(PyObject *classobj, PyObject *arg, PyObject *kw);
-    PyObject* ( *PyMethod_New)(PyObject *func, PyObject *self, PyObject *classobj);
-    PyObject* ( *PyCapsule_New)(void *pointer, const char *name, PyCapsule_Destructor destructor);
-    void* ( *PyCapsule_GetPointer)(PyObject *capsule, const char *name);
-    int ( *PyObject_SetAttrString)(PyObject *o, const char *attr_name, PyObject *v);
-    int ( *PyObject_IsInstance)(PyObject *inst, PyObject *cls);
-    PyObject* ( *PyUnicode_FromWideChar)(const wchar_t *w, size_t size);
-    PyObject* ( *PyBool_FromLong)(long v);
-    size_t( *PyList_Size)(PyObject* list);
-    PyObject* ( *PyList_GetItem)(PyObject *list, size_t index);
-    PyObject* ( *PyFile_FromString)(char *filename, char *mode);
-    FILE* ( *PyFile_AsFile)(PyObject *pyfile);
-    PyObject* ( *PyUnicode_FromString)(const char *u);
-    PyObject* ( *PyInstanceMethod_New)(PyObject *func);
-    size_t( *PyUnicode_AsWideChar)(PyObject *unicode, wchar_t *w, size_t size);
-    FILE* (  *_Py_fopen_obj)(PyObject *pyfile, const char* mode);
-    int( *Py_AddPendingCall)(int(*func)(void *), void *arg);
-    PyGILState_STATE( *PyGILState_Ensure)();
-    void( *PyGILState_Release)(PyGILState_STATE state);
-    PyObject* ( *PyDescr_NewMethod)(PyObject* type, struct PyMethodDef *meth);
-    size_t (*PyGC_Collect)(void);
-    void(*PyImport_Cleanup)(void);
-    int(*PyGILState_Check)(void);
+    void checkApi(PythonApi api) const
+    {
+        if (!m_apiAvailable.test(api))
+            throwUnsupportedApi(api);
+    }
+
+    void resolveApi();
+    void throwUnsupportedApi(PythonApi api) const;
+
+    std::bitset<PythonApiCount>  m_apiAvailable;
+    double  m_loadTime;
+    double  m_resolveTime;
+    double  m_initTime;
+
+    void applyManifest(const ManifestInterpreter* desc);
 
     HMODULE  m_handlePython;
+    DWORD  m_initThreadId;
     PyThreadState*  m_globalState;
     PythonInterpreter*  m_globalInterpreter;
     bool m_pykdInit;
+
+    // sub-interpreters made ready for --local by the background thread
+    std::list<PythonInterpreter*>  m_localPool;
+    size_t  m_localPoolHits;
+    size_t  m_localPoolMisses;
+    size_t  m_localPoolRefillCount;
+    double  m_localPoolRefillTime;
+
+    // --local interpreters ended by the background thread or inline when the queue is full
+    size_t  m_teardownDeferred;
+    double  m_teardownDeferredTime;
+    size_t  m_teardownInline;
+
+    std::string  m_home;
+    std::wstring  m_homeW;
+
+    // installed by the first !py --arena
+    ObjectArena*  m_arena;
+
+    size_t  m_codeCacheHits;
+    size_t  m_codeCacheMisses;
+
+    size_t  m_sourceCacheHits;
+    size_t  m_sourceCacheMisses;
+};
+
+// Function table of the interpreter bound by PythonSingleton::getInterpreter.
+// The C API wrappers below read it directly instead of resolving the current
+// interpreter through the singleton on every call. It is written by the command
+// ( or preload ) thread and read by the background, interrupt and script threads.
+static std::atomic<PyModule*>  activeModule(NULL);
+
+// Inline refcounting is process wide: any thread may change the count of an object
+// of any loaded interpreter whatever module is active. So the count is changed
+// inline only while one python version is loaded, set by PythonSingleton::getInterpreter.
+std::atomic<PyRefcountMode>  pyRefcountMode(PyRefcountDispatch);
+
+// Function table for the C API wrappers called by a thread which works on an
+// interpreter without activating it ( the background teardown and pool refill ):
+// it takes precedence over activeModule, which belongs to the running command.
+static thread_local PyModule*  threadModule = NULL;
+
+class ThreadModuleBinding
+{
+public:
+
+    explicit ThreadModuleBinding(PyModule* module) :
+        m_previous(threadModule)
+    {
+        threadModule = module;
+    }
+
+    ~ThreadModuleBinding()
+    {
+        threadModule = m_previous;
+    }
+
+private:
+
+    ThreadModuleBinding(const ThreadModuleBinding&) = delete;
+
+    PyModule*  m_previous;
 };
 
+static void setActiveModule(PyModule* module)
+{
+    activeModule.store(module, std::memory_order_release);
+}
+
+
+
+// compiled script file kept by the interpreter, see compileScriptFile
+struct CompiledScript {
+    unsigned long long  size;
+    unsigned long long  writeTime;
+    PyObject*  code;
+};
 
 
 class PythonInterpreter
@@ -154,18 +183,73 @@ public:
         m_module(mod)
     {
         m_state = mod->Py_NewInterpreter();
+        m_threadId = GetCurrentThreadId();
     }
 
     ~PythonInterpreter()
     {
+        if (!m_state)
+            return;
+
         m_module->PyEval_RestoreThread(m_state);
+        endInterpreter();
+    }
+
+    // A pooled interpreter is created by the background thread and its thread state
+    // keeps that thread id ( threading.main_thread, PyThreadState_SetAsyncExc ).
+    // The command thread replaces it by a new one of its own, with the GIL held.
+    void attachToCurrentThread()
+    {
+        if (m_threadId == GetCurrentThreadId())
+            return;
+
+        PyThreadState*  state = m_module->PyThreadState_New(PyThreadState_GetInterpreter(m_state));
+        PyThreadState*  previous = m_module->PyThreadState_Swap(state);
+
+        m_module->PyThreadState_Clear(m_state);
+        m_module->PyThreadState_Delete(m_state);
+
+        m_module->PyThreadState_Swap(previous);
+
+        m_state = state;
+        m_threadId = GetCurrentThreadId();
+    }
+
+    // the interpreter thread state must be the current one
+    void endInterpreter()
+    {
+        for (auto& obj : m_objects)
+            m_module->Py_DecRef(obj.second);
+        m_objects.clear();
+
+        for (auto& script : m_scripts)
+            m_module->Py_DecRef(script.second.code);
+        m_scripts.clear();
+
+        for (auto& source : m_sources)
+            m_module->Py_DecRef(source.second);
+        m_sources.clear();
+        m_sourceIndex.clear();
 
         m_module->Py_EndInterpreter(m_state);
+        m_state = NULL;
     }
 
     PyModule*  m_module;
 
     PyThreadState*  m_state;
+
+    // the thread state keeps the id of the thread which created it
+    DWORD  m_threadId;
+
+    std::map<std::string, PyObject*>  m_objects;
+
+    // by resolved path
+    std::map<std::string, CompiledScript>  m_scripts;
+
+    // -c and -e code by mode and source text, the most recently used first
+    std::list<std::pair<std::string, PyObject*>>  m_sources;
+    std::map<std::string, std::list<std::pair<std::string, PyObject*>>::iterator>  m_sourceIndex;
 };
 
 
@@ -181,6 +265,16 @@ public:
         return m_singleton.get();
     }
 
+    PythonSingleton() :
+        m_currentInterpreter(0),
+        m_currentIsGlobal(false),
+        m_releaseTime(0),
+        m_releaseDeferred(false),
+        m_backgroundThread(NULL),
+        m_backgroundEvent(NULL),
+        m_backgroundStop(false)
+    {}
+
 
     PythonInterpreter* currentInterpreter()
     {
@@ -205,18 +299,26 @@ public:
 
     PythonInterpreter* getInterpreter(int majorVersion, int minorVersion, bool global)
     {
+        // held until releaseInterpretor: the background work runs only between commands
+        std::unique_lock<std::recursive_mutex>  lock(m_lock);
+
         PyModule*  module = 0;
 
         if (m_modules.find(std::make_pair(majorVersion, minorVersion)) == m_modules.end())
         {
             module = new PyModule(majorVersion, minorVersion);
             m_modules.insert(std::make_pair(std::make_pair(majorVersion, minorVersion), module));
+
+            // objects of the first version may still be counted inline until this store
+            pyRefcountMode.store(m_modules.size() == 1 ? module->refcountMode : PyRefcountDispatch, std::memory_order_relaxed);
         }
         else
         {
             module = m_modules[std::make_pair(majorVersion, minorVersion)];
         }
 
+        setActiveModule(module);
+
         module->PyEval_RestoreThread(module->m_globalState);
         module->checkPykd();
 
@@ -232,29 +334,82 @@ public:
         }
         else
         {
-            m_currentInterpreter = new PythonInterpreter(module);
+            m_currentInterpreter = takePooledInterpreter(module);
+            if (m_currentInterpreter)
+                m_currentInterpreter->attachToCurrentThread();
+            else
+                m_currentInterpreter = new PythonInterpreter(module);
             m_currentIsGlobal = false;
         }
 
         module->PyThreadState_Swap(m_currentInterpreter->m_state);
-        
+
+        lock.release();
+
         return m_currentInterpreter;
     }
 
     void releaseInterpretor(PythonInterpreter* interpret)
     {
+        PerfTimer  timer;
+
         PyModule*  module = m_currentInterpreter->m_module;
 
         m_currentInterpreter->m_state = module->PyEval_SaveThread();
 
+        m_releaseDeferred = false;
+
         if (!m_currentIsGlobal)
         {
-            delete m_currentInterpreter;
-            module->PyThreadState_Swap(module->m_globalState);
-            module->m_globalState = module->PyEval_SaveThread();
+            if (m_retired.size() < teardownQueueSize())
+            {
+                m_retired.push_back(m_currentInterpreter);
+                m_releaseDeferred = true;
+            }
+            else
+            {
+                delete m_currentInterpreter;
+                module->PyThreadState_Swap(module->m_globalState);
+                module->m_globalState = module->PyEval_SaveThread();
+                ++module->m_teardownInline;
+            }
         }
 
         m_currentInterpreter = 0;
+        setActiveModule(NULL);
+
+        if (!m_retired.empty() || module->m_localPool.size() < localPoolSize())
+            startBackgroundWork();
+
+        m_releaseTime = timer.elapsed();
+
+        m_lock.unlock();
+    }
+
+    void getReleaseInfo(double& time, bool& deferred)
+    {
+        std::lock_guard<std::recursive_mutex>  lock(m_lock);
+
+        time = m_releaseTime;
+        deferred = m_releaseDeferred;
+    }
+
+    void warmupInterpreter(int majorVersion, int minorVersion, const std::list<std::string>& modules)
+    {
+        PythonInterpreter*  interpreter = getInterpreter(majorVersion, minorVersion, true);
+
+        PyModule*  pyModule = activeModule.load(std::memory_order_acquire);
+
+        for (const std::string& name : modules)
+        {
+            PyObject*  module = pyModule->PyImport_ImportModule(name.c_str());
+            if (module)
+                pyModule->Py_DecRef(module);
+            else
+                pyModule->PyErr_Clear();
+        }
+
+        releaseInterpretor(interpreter);
     }
 
     bool isInterpreterLoaded(int majorVersion, int minorVersion)
@@ -262,254 +417,837 @@ public:
         return m_modules.find(std::make_pair(majorVersion, minorVersion)) != m_modules.end();
     }
 
+    PyModule* getLoadedModule(int majorVersion, int minorVersion)
+    {
+        auto  it = m_modules.find(std::make_pair(majorVersion, minorVersion));
+        return it != m_modules.end() ? it->second : 0;
+    }
+
+    void getLocalPoolInfo(PyModule* module, InterpreterLoadInfo& info)
+    {
+        std::lock_guard<std::recursive_mutex>  lock(m_lock);
+
+        info.localPoolReady = module->m_localPool.size();
+        info.localPoolHits = module->m_localPoolHits;
+        info.localPoolMisses = module->m_localPoolMisses;
+        info.localPoolRefillCount = module->m_localPoolRefillCount;
+        info.localPoolRefillTime = module->m_localPoolRefillTime;
+
+        info.teardownPending = std::count_if(m_retired.begin(), m_retired.end(),
+            [module](PythonInterpreter* interpreter) { return interpreter->m_module == module; });
+        info.teardownDeferred = module->m_teardownDeferred;
+        info.teardownDeferredTime = module->m_teardownDeferredTime;
+        info.teardownInline = module->m_teardownInline;
+    }
+
     void stopAllInterpreter()
     {
+        stopBackgroundWork();
+
+        for (PythonInterpreter* interpreter : m_retired)
+        {
+            PyModule*  module = interpreter->m_module;
+            setActiveModule(module);
+            delete interpreter;
+            module->PyThreadState_Swap(module->m_globalState);
+            module->m_globalState = module->PyEval_SaveThread();
+        }
+
+        m_retired.clear();
+
         for (auto m : m_modules)
         {
             m_currentInterpreter = m.second->m_globalInterpreter;
+            setActiveModule(m.second);
             m.second->deactivate();
         }
         m_currentInterpreter = 0;
+        setActiveModule(NULL);
     }
 
 private:
 
+    static size_t localPoolSize()
+    {
+        int  size = Manifest::get().getIntOption("localPool", 0);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+    }
+
+    // finished --local interpreters waiting for the background teardown, 0 ends them inline
+    static size_t teardownQueueSize()
+    {
+        int  size = Manifest::get().getIntOption("teardownQueue", 4);
+        return size > 0 ? static_cast<size_t>(size) : 0;
+    }
+
+    PythonInterpreter* takePooledInterpreter(PyModule* module)
+    {
+        if (localPoolSize() == 0)
+            return 0;
+
+        if (module->m_localPool.empty())
+        {
+            ++module->m_localPoolMisses;
+            return 0;
+        }
+
+        ++module->m_localPoolHits;
+
+        PythonInterpreter*  interpreter = module->m_localPool.front();
+        module->m_localPool.pop_front();
+        return interpreter;
+    }
+
+    void startBackgroundWork()
+    {
+        if (!m_backgroundEvent)
+        {
+            m_backgroundEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+            if (!m_backgroundEvent)
+                return;
+
+            m_backgroundThread = CreateThread(NULL, 0, backgroundRoutine, this, 0, NULL);
+            if (!m_backgroundThread)
+            {
+                CloseHandle(m_backgroundEvent);
+                m_backgroundEvent = NULL;
+                return;
+            }
+        }
+
+        SetEvent(m_backgroundEvent);
+    }
+
+    void stopBackgroundWork()
+    {
+        if (!m_backgroundThread)
+            return;
+
+        {
+            std::lock_guard<std::recursive_mutex>  lock(m_lock);
+            m_backgroundStop = true;
+        }
+
+        SetEvent(m_backgroundEvent);
+        WaitForSingleObject(m_backgroundThread, INFINITE);
+
+        CloseHandle(m_backgroundThread);
+        CloseHandle(m_backgroundEvent);
+        m_backgroundThread = NULL;
+        m_backgroundEvent = NULL;
+    }
+
+    static DWORD WINAPI backgroundRoutine(LPVOID param)
+    {
+        static_cast<PythonSingleton*>(param)->runBackgroundWork();
+        return 0;
+    }
+
+    // ends retired interpreters first, then refills the pools
+    void runBackgroundWork()
+    {
+        for (;;)
+        {
+            WaitForSingleObject(m_backgroundEvent, INFINITE);
+
+            while (endRetiredInterpreter())
+                ;
+
+            std::list<PyModule*>  modules;
+
+            {
+                std::lock_guard<std::recursive_mutex>  lock(m_lock);
+
+                if (m_backgroundStop)
+                    return;
+
+                for (auto m : m_modules)
+                    modules.push_back(m.second);
+            }
+
+            for (PyModule* module : modules)
+                refillPool(module);
+        }
+    }
+
+    bool endRetiredInterpreter()
+    {
+        PythonInterpreter*  interpreter;
+
+        {
+            std::lock_guard<std::recursive_mutex>  lock(m_lock);
+
+            if (m_backgroundStop || m_retired.empty())
+                return false;
+
+            interpreter = m_retired.front();
+            m_retired.pop_front();
+        }
+
+        // not under m_lock: Py_EndInterpreter may run python code and wait for its
+        // threads, a command started meanwhile is ordered with it by the GIL only
+        PyModule*  module = interpreter->m_module;
+
+        // deallocators of bound objects call the wrappers, the command may use another module
+        ThreadModuleBinding  binding(module);
+
+        PerfTimer  timer;
+
+        PyGILState_STATE  state = module->PyGILState_Ensure();
+        PyThreadState*  mainState = module->PyThreadState_Get();
+
+        module->PyThreadState_Swap(interpreter->m_state);
+        interpreter->endInterpreter();
+
+        module->PyThreadState_Swap(mainState);
+        module->PyGILState_Release(state);
+
+        delete interpreter;
+
+        std::lock_guard<std::recursive_mutex>  lock(m_lock);
+
+        ++module->m_teardownDeferred;
+        module->m_teardownDeferredTime += timer.elapsed();
+
+        return true;
+    }
+
+    void refillPool(PyModule* module)
+    {
+        size_t  count = 0;
+        double  time = 0;
+
+        for (;;)
+        {
+            // one interpreter per lock: a command started meanwhile waits for one creation at most
+            std::lock_guard<std::recursive_mutex>  lock(m_lock);
+
+            if (m_backgroundStop || module->m_localPool.size() >= localPoolSize())
+                break;
+
+            PerfTimer  timer;
+            module->m_localPool.push_back(createPooledInterpreter(module));
+            time += timer.elapsed();
+            ++count;
+        }
+
+        if (count > 0)
+        {
+            module->m_localPoolRefillCount = count;
+            module->m_localPoolRefillTime = time;
+        }
+    }
+
+    // Runs on the background thread under a temporary thread state of the main interpreter.
+    // The command thread which takes the interpreter gives it a thread state of its own
+    // ( PythonInterpreter::attachToCurrentThread ). pykd is not imported here: the command
+    // imports it when it needs it ( no-pykd scripts do not ), on its own thread.
+    PythonInterpreter* createPooledInterpreter(PyModule* module)
+    {
+        ThreadModuleBinding  binding(module);
+
+        PyGILState_STATE  state = module->PyGILState_Ensure();
+        PyThreadState*  mainState = module->PyThreadState_Get();
+
+        PythonInterpreter*  interpreter = new PythonInterpreter(module);
+
+        PyObject*  mainModule = module->PyImport_ImportModule("__main__");
+        if (mainModule)
+            module->Py_DecRef(mainModule);
+
+        module->PyErr_Clear();
+
+        module->PyThreadState_Swap(mainState);
+        module->PyGILState_Release(state);
+
+        return interpreter;
+    }
+
     static std::auto_ptr<PythonSingleton>  m_singleton;
 
     std::map<std::pair<int,int>, PyModule*>  m_modules;
    
     PythonInterpreter*  m_currentInterpreter;
     bool  m_currentIsGlobal;
+
+    std::recursive_mutex  m_lock;
+
+    // the last releaseInterpretor, for !py --timing
+    double  m_releaseTime;
+    bool  m_releaseDeferred;
+
+    std::list<PythonInterpreter*>  m_retired;
+
+    HANDLE  m_backgroundThread;
+    HANDLE  m_backgroundEvent;
+    bool  m_backgroundStop;
 };
 
 std::auto_ptr<PythonSingleton>  PythonSingleton::m_singleton; 
 
-HMODULE LoadPythonForKey(HKEY installPathKey, int majorVersion, int minorVersion)
+inline PyModule* currentModule()
+{
+    if (threadModule)
+        return threadModule;
+
+    PyModule*  module = activeModule.load(std::memory_order_acquire);
+    if (module)
+        return module;
+
+    return PythonSingleton::get()->currentInterpreter()->m_module;
+}
+
+inline PyModule* currentModule(PythonApi api)
+{
+    PyModule*  module = currentModule();
+    module->checkApi(api);
+    return module;
+}
+
+#ifndef REG_NOTIFY_THREAD_AGNOSTIC
+#define REG_NOTIFY_THREAD_AGNOSTIC  0x10000000L
+#endif
+
+namespace {
+
+#if defined(_M_X64)
+const WORD  processImageMachine = IMAGE_FILE_MACHINE_AMD64;
+#elif defined(_M_ARM64)
+const WORD  processImageMachine = IMAGE_FILE_MACHINE_ARM64;
+#else
+const WORD  processImageMachine = IMAGE_FILE_MACHINE_I386;
+#endif
+
+bool isFileExists(const std::string& path)
+{
+    DWORD  attr = GetFileAttributesA(path.c_str());
+    return attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY) == 0;
+}
+
+bool getFileWriteTime(const std::string& path, FILETIME& writeTime)
 {
-    HMODULE  hmodule = NULL;
+    WIN32_FILE_ATTRIBUTE_DATA  attrData;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attrData))
+        return false;
 
+    writeTime = attrData.ftLastWriteTime;
+    return true;
+}
+
+// reads the PE headers instead of mapping the image: LoadLibrary would run
+// DllMain and let AV scan every installed python on each discovery
+bool isImageForThisProcess(const std::string& path)
+{
+    HANDLE  file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    BYTE  headers[0x1000];
+    DWORD  read = 0;
+    BOOL  readResult = ReadFile(file, headers, sizeof(headers), &read, NULL);
+    CloseHandle(file);
+
+    if (!readResult || read < sizeof(IMAGE_DOS_HEADER))
+        return false;
+
+    const IMAGE_DOS_HEADER*  dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(headers);
+    if (dosHeader->e_magic != IMAGE_DOS_SIGNATURE || dosHeader->e_lfanew < 0 ||
+        static_cast<DWORD>(dosHeader->e_lfanew) + sizeof(DWORD) + sizeof(IMAGE_FILE_HEADER) > read)
+        return false;
+
+    const BYTE*  ntHeaders = headers + dosHeader->e_lfanew;
+    if (*reinterpret_cast<const DWORD*>(ntHeaders) != IMAGE_NT_SIGNATURE)
+        return false;
+
+    const IMAGE_FILE_HEADER*  fileHeader = reinterpret_cast<const IMAGE_FILE_HEADER*>(ntHeaders + sizeof(DWORD));
+    return fileHeader->Machine == processImageMachine;
+}
+
+// a version resource that disagrees with the registry key means a stale or
+// foreign image; an image without the resource is accepted
+bool isImageVersionMatch(const std::string& path, int majorVersion, int minorVersion)
+{
+    DWORD  handle = 0;
+    DWORD  size = GetFileVersionInfoSizeA(path.c_str(), &handle);
+    if (size == 0)
+        return true;
+
+    std::vector<BYTE>  versionInfo(size);
+    if (!GetFileVersionInfoA(path.c_str(), 0, size, &versionInfo[0]))
+        return true;
+
+    VS_FIXEDFILEINFO*  fileInfo = NULL;
+    UINT  fileInfoSize = 0;
+    if (!VerQueryValueA(&versionInfo[0], "\\", reinterpret_cast<LPVOID*>(&fileInfo), &fileInfoSize) || fileInfoSize < sizeof(VS_FIXEDFILEINFO))
+        return true;
+
+    return HIWORD(fileInfo->dwFileVersionMS) == majorVersion && LOWORD(fileInfo->dwFileVersionMS) == minorVersion;
+}
+
+std::string findPythonImage(HKEY installPathKey, int majorVersion, int minorVersion)
+{
     char  installPath[1000];
     DWORD  installPathSize = sizeof(installPath);
 
-    if (ERROR_SUCCESS == RegQueryValueExA(installPathKey, NULL, NULL, NULL, (LPBYTE)installPath, &installPathSize))
+    if (ERROR_SUCCESS != RegQueryValueExA(installPathKey, NULL, NULL, NULL, (LPBYTE)installPath, &installPathSize))
+        return "";
+
+    std::stringstream  dllName;
+    dllName << "python" << majorVersion << minorVersion << ".dll";
+
+    std::string  imagePath = std::string(installPath) + dllName.str();
+
+    if (!isFileExists(imagePath))
     {
-        std::stringstream  dllName;
-        dllName << "python" << majorVersion << minorVersion << ".dll";
+        //search in common places as system32
+        char  searchPath[MAX_PATH];
+        DWORD  searchResult = SearchPathA(NULL, dllName.str().c_str(), NULL, sizeof(searchPath), searchPath, NULL);
+        if (searchResult == 0 || searchResult >= sizeof(searchPath))
+            return "";
 
-        std::stringstream  imagePath;
-        imagePath << installPath << dllName.str();
+        imagePath = searchPath;
+    }
 
-        //load by full string
-        hmodule = LoadLibraryA(imagePath.str().c_str());
-        if (hmodule)
-            return hmodule;
+    if (!isImageForThisProcess(imagePath) || !isImageVersionMatch(imagePath, majorVersion, minorVersion))
+        return "";
 
-        hmodule = LoadLibraryExA(imagePath.str().c_str(), NULL, LOAD_WITH_ALTERED_SEARCH_PATH);
-        if (hmodule)
-           return hmodule;
+    return imagePath;
+}
 
-        //search in common places as system32
-        hmodule = LoadLibraryA(dllName.str().c_str());
-        if (hmodule)
-            return hmodule;
+std::list<InterpreterDesc>  findInstalledInterpreter()
+{
+    std::set<InterpreterDesc>  interpretSet;
+
+    for (auto rootKey : std::list<HKEY>({ HKEY_LOCAL_MACHINE, HKEY_CURRENT_USER }))
+    {
+        HKey  pythonCoreKey;
+        
+        if (ERROR_SUCCESS != RegOpenKeyA(rootKey, "SOFTWARE\\Python\\PythonCore", pythonCoreKey))
+            continue;
+
+        for (DWORD i = 0;; ++i)
+        {
+            char  versionStr[20];
+            if (ERROR_SUCCESS != RegEnumKeyA(pythonCoreKey, i, versionStr, sizeof(versionStr)))
+                break;
+
+            int  majorVersion = -1, minorVersion = -1;
+            sscanf_s(versionStr, "%d.%d", &majorVersion, &minorVersion);
+
+            // free-threaded builds are registered apart as "3.13t"
+            if (strchr(versionStr, 't'))
+                continue;
+
+            HKey  installPathKey;
+            std::string   installPathStr(versionStr);
+            installPathStr += "\\InstallPath";
+
+            if (ERROR_SUCCESS != RegOpenKeyA(pythonCoreKey, installPathStr.c_str(), installPathKey))
+                continue;
+
+            std::string  imagePath = findPythonImage(installPathKey, majorVersion, minorVersion);
+            
+            if (!imagePath.empty())
+                interpretSet.insert({ majorVersion, minorVersion, imagePath });
+        }
     }
 
-    return NULL;
+    std::list<InterpreterDesc>  interpretLst;
+
+    std::copy(interpretSet.begin(), interpretSet.end(), std::inserter(interpretLst, interpretLst.begin()));
+
+    interpretLst.sort();
+
+    return interpretLst;
 }
 
+} // anonymous namespace
 
-HMODULE LoadPythonLibrary(int majorVersion, int minorVersion)
+///////////////////////////////////////////////////////////////////////////////
+
+// Discovery result kept for the extension lifetime. It is dropped when the
+// PythonCore registry keys change ( watched with RegNotifyChangeKeyValue ) or
+// when a discovered image is replaced or removed, so a repeated lookup costs
+// one event poll and one attribute query per image.
+class InterpreterCache
 {
+public:
 
-    HKey  pythonCoreKey;
+    InterpreterCache() : m_valid(false)
+    {}
 
-    for (auto rootKey : std::list<HKEY>({ HKEY_LOCAL_MACHINE, HKEY_CURRENT_USER }))
+    ~InterpreterCache()
     {
-        if (ERROR_SUCCESS == RegOpenKeyA(rootKey, "SOFTWARE\\Python\\PythonCore", pythonCoreKey))
+        closeWatch();
+    }
+
+    std::list<InterpreterDesc> get()
+    {
+        std::lock_guard<std::mutex>  lock(m_lock);
+
+        if (!m_valid || isChanged())
+            rebuild();
+
+        return m_interpreters;
+    }
+
+private:
+
+    struct ImageStamp {
+        std::string  path;
+        FILETIME  writeTime;
+    };
+
+    struct RegistryWatch {
+        HKEY  key;
+        HANDLE  event;
+    };
+
+    bool isChanged() const
+    {
+        for (const RegistryWatch& watch : m_watches)
         {
-            HKey  installPathKey;
+            if (WaitForSingleObject(watch.event, 0) != WAIT_TIMEOUT)
+                return true;
+        }
 
-            std::stringstream   installPathStr;
+        for (const ImageStamp& image : m_images)
+        {
+            FILETIME  writeTime;
+            if (!getFileWriteTime(image.path, writeTime) || CompareFileTime(&writeTime, &image.writeTime) != 0)
+                return true;
+        }
 
-            if (majorVersion == 2 || (majorVersion == 3 && minorVersion <= 4))
-            {
-                installPathStr << majorVersion << '.' << minorVersion << "\\InstallPath";
-            }
-            else
-            if (majorVersion == 3 && minorVersion >= 5)
+        return false;
+    }
+
+    void rebuild()
+    {
+        // arm the notifications before reading, so a change made while
+        // reading invalidates the new result
+        closeWatch();
+
+        for (auto rootKey : std::list<HKEY>({ HKEY_LOCAL_MACHINE, HKEY_CURRENT_USER }))
+        {
+            // Watch the nearest existing key: a first install creates PythonCore. Only
+            // PythonCore is watched with its subtree, a parent is watched for its own
+            // subkeys ( SOFTWARE as a whole changes all the time ). The next rebuild
+            // moves the watch down when the missing key appears.
+            for (auto keyName : { "SOFTWARE\\Python\\PythonCore", "SOFTWARE\\Python", "SOFTWARE" })
             {
-#ifdef _M_X64
-                installPathStr << majorVersion << '.' << minorVersion << "\\InstallPath";
-#else
-                installPathStr << majorVersion << '.' << minorVersion << "-32" << "\\InstallPath";
-#endif
+                HKEY  key = NULL;
+                if (ERROR_SUCCESS != RegOpenKeyExA(rootKey, keyName, 0, KEY_NOTIFY, &key))
+                    continue;
+
+                RegistryWatch  watch = { key, CreateEvent(NULL, TRUE, FALSE, NULL) };
+
+                bool  pythonCore = strcmp(keyName, "SOFTWARE\\Python\\PythonCore") == 0;
+
+                RegNotifyChangeKeyValue(key, pythonCore ? TRUE : FALSE,
+                    (pythonCore ? REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET : REG_NOTIFY_CHANGE_NAME) | REG_NOTIFY_THREAD_AGNOSTIC,
+                    watch.event, TRUE);
+
+                m_watches.push_back(watch);
+                break;
             }
+        }
+
+        m_interpreters = findInstalledInterpreter();
+
+        m_images.clear();
+        for (const InterpreterDesc& desc : m_interpreters)
+        {
+            ImageStamp  image = { desc.imagePath };
+            if (getFileWriteTime(desc.imagePath, image.writeTime))
+                m_images.push_back(image);
+        }
+
+        m_valid = true;
+    }
+
+    void closeWatch()
+    {
+        for (const RegistryWatch& watch : m_watches)
+        {
+            RegCloseKey(watch.key);
+            CloseHandle(watch.event);
+        }
+
+        m_watches.clear();
+    }
+
+    std::mutex  m_lock;
+    bool  m_valid;
+    std::list<InterpreterDesc>  m_interpreters;
+    std::vector<ImageStamp>  m_images;
+    std::vector<RegistryWatch>  m_watches;
+};
+
+static InterpreterCache  interpreterCache;
+
+std::list<InterpreterDesc>  getInstalledInterpreter()
+{
+    const Manifest&  manifest = Manifest::get();
+
+    if (!manifest.replacesRegistry())
+        return interpreterCache.get();
+
+    std::list<InterpreterDesc>  interpretLst;
+
+    for (const auto& it : manifest.interpreters())
+        interpretLst.push_back({ it.second.majorVersion, it.second.minorVersion, it.second.imagePath });
+
+    return interpretLst;
+}
+
+HMODULE LoadPythonLibrary(int majorVersion, int minorVersion)
+{
+    for (const InterpreterDesc& desc : getInstalledInterpreter())
+    {
+        if (desc.majorVersion != majorVersion || desc.minorVersion != minorVersion)
+            continue;
+
+        //load by full string
+        HMODULE  hmodule = LoadLibraryA(desc.imagePath.c_str());
+        if (hmodule)
+            return hmodule;
+
+        hmodule = LoadLibraryExA(desc.imagePath.c_str(), NULL, LOAD_WITH_ALTERED_SEARCH_PATH);
+        if (hmodule)
+            return hmodule;
+    }
+
+    return NULL;
+}
+
+namespace {
+
+enum PythonApiKind {
+    PythonApiKind_Data,
+    PythonApiKind_DataPtr,
+    PythonApiKind_Func
+};
+
+struct PythonApiDesc {
+    const char*  name;
+    const char*  py2Export;
+    const char*  py3Export;
+    size_t  offset;
+    PythonApiKind  kind;
+    bool  required;
+};
+
+const PythonApiDesc  pythonApiDesc[PythonApiCount] = {
+
+#define PYTHON_API_DATA(type, name, py2Export, py3Export, required) \
+    { #name, py2Export, py3Export, offsetof(PyApiTable, name), PythonApiKind_Data, required },
+#define PYTHON_API_DATA_PTR(name, py2Export, py3Export, required) \
+    { #name, py2Export, py3Export, offsetof(PyApiTable, name), PythonApiKind_DataPtr, required },
+#define PYTHON_API_FUNC(ret, name, args, py2Export, py3Export, required) \
+    { #name, py2Export, py3Export, offsetof(PyApiTable, name), PythonApiKind_Func, required },
+#include "pyapitable.h"
+#undef PYTHON_API_DATA
+#undef PYTHON_API_DATA_PTR
+#undef PYTHON_API_FUNC
+
+};
+
+} // anonymous namespace
+
+void PyModule::resolveApi()
+{
+    std::vector<ExportRequest>  requests;
+    requests.reserve(PythonApiCount);
 
-            if (ERROR_SUCCESS == RegOpenKeyA(pythonCoreKey, installPathStr.str().c_str(), installPathKey))
-            {
-                HMODULE  hmodule = LoadPythonForKey(installPathKey, majorVersion, minorVersion);
-                if (hmodule)
-                    return hmodule;
-            }
-        }
+    for (size_t i = 0; i < PythonApiCount; ++i)
+    {
+        const char*  exportName = isPy3 ? pythonApiDesc[i].py3Export : pythonApiDesc[i].py2Export;
+        if (exportName)
+            requests.push_back({ exportName, i });
     }
 
-    return NULL;
-}
+    // the export name table is sorted, so one merge pass resolves the whole table
+    std::sort(requests.begin(), requests.end());
 
+    std::vector<FARPROC>  found(PythonApiCount, NULL);
 
-std::list<InterpreterDesc>  getInstalledInterpreter()
-{
-    std::set<InterpreterDesc>  interpretSet;
+    const BYTE*  imageBase = reinterpret_cast<const BYTE*>(m_handlePython);
+    const IMAGE_DOS_HEADER*  dosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(imageBase);
+    const IMAGE_NT_HEADERS*  ntHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(imageBase + dosHeader->e_lfanew);
+    const IMAGE_DATA_DIRECTORY&  exportDir = ntHeaders->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT];
 
-    for (auto rootKey : std::list<HKEY>({ HKEY_LOCAL_MACHINE, HKEY_CURRENT_USER }))
+    if (exportDir.VirtualAddress != 0 && exportDir.Size != 0)
     {
-        HKey  pythonCoreKey;
-        
-        if (ERROR_SUCCESS != RegOpenKeyA(rootKey, "SOFTWARE\\Python\\PythonCore", pythonCoreKey))
-            continue;
+        const IMAGE_EXPORT_DIRECTORY*  exports = reinterpret_cast<const IMAGE_EXPORT_DIRECTORY*>(imageBase + exportDir.VirtualAddress);
+        const DWORD*  names = reinterpret_cast<const DWORD*>(imageBase + exports->AddressOfNames);
+        const WORD*  ordinals = reinterpret_cast<const WORD*>(imageBase + exports->AddressOfNameOrdinals);
+        const DWORD*  functions = reinterpret_cast<const DWORD*>(imageBase + exports->AddressOfFunctions);
 
-        for (DWORD i = 0;; ++i)
+        auto  exportName = [&](size_t i) {
+            return reinterpret_cast<const char*>(imageBase + names[i]);
+        };
+
+        mergeExports(requests, exports->NumberOfNames, exportName, [&](size_t i, const ExportRequest& request)
         {
-            char  versionStr[20];
-            if (ERROR_SUCCESS != RegEnumKeyA(pythonCoreKey, i, versionStr, sizeof(versionStr)))
-                break;
+            DWORD  rva = functions[ordinals[i]];
 
-            int  majorVersion = -1, minorVersion = -1;
-            sscanf_s(versionStr, "%d.%d", &majorVersion, &minorVersion);
+            bool  forwarded = rva >= exportDir.VirtualAddress && rva < exportDir.VirtualAddress + exportDir.Size;
 
-            HKey  installPathKey;
-            std::string   installPathStr(versionStr);
-            installPathStr += "\\InstallPath";
+            found[request.api] = forwarded ?
+                GetProcAddress(m_handlePython, exportName(i)) :
+                reinterpret_cast<FARPROC>(const_cast<BYTE*>(imageBase + rva));
+        });
+    }
 
-            if (ERROR_SUCCESS != RegOpenKeyA(pythonCoreKey, installPathStr.c_str(), installPathKey))
-                continue;
+    std::stringstream  missing;
 
-            HMODULE  hmodule = LoadPythonForKey(installPathKey, majorVersion, minorVersion);
-            
-            if (hmodule)
-            {
-                char  fullPath[1000];
-            
-                if (GetModuleFileNameA(hmodule, fullPath, sizeof(fullPath)))
-                {
-                    interpretSet.insert({ majorVersion, minorVersion, fullPath });
-                }
-            
-                FreeLibrary(hmodule);
-            }
-        }
-    }
+    for (size_t i = 0; i < PythonApiCount; ++i)
+    {
+        const PythonApiDesc&  desc = pythonApiDesc[i];
+        void*  field = reinterpret_cast<BYTE*>(static_cast<PyApiTable*>(this)) + desc.offset;
 
-    std::list<InterpreterDesc>  interpretLst;
+        m_apiAvailable.set(i, found[i] != NULL);
 
-    std::copy(interpretSet.begin(), interpretSet.end(), std::inserter(interpretLst, interpretLst.begin()));
+        if (!found[i])
+        {
+            *reinterpret_cast<void**>(field) = NULL;
 
-    interpretLst.sort();
+            if (desc.required && (isPy3 ? desc.py3Export : desc.py2Export))
+                missing << ' ' << desc.name;
 
-    return interpretLst;
+            continue;
+        }
+
+        if (desc.kind == PythonApiKind_DataPtr)
+            *reinterpret_cast<void**>(field) = *reinterpret_cast<void**>(found[i]);
+        else
+            *reinterpret_cast<FARPROC*>(field) = found[i];
+    }
+
+    if (!missing.str().empty())
+    {
+        std::stringstream  sstr;
+        sstr << "python module does not export required C API:" << missing.str() << std::endl;
+        throw std::exception(sstr.str().c_str());
+    }
+}
+
+void PyModule::throwUnsupportedApi(PythonApi api) const
+{
+    std::stringstream  sstr;
+    sstr << "Unsupported C API " << pythonApiDesc[api].name << std::endl;
+    throw std::exception(sstr.str().c_str());
 }
 
-PyModule::PyModule(int majorVesion, int minorVersion)
+PyModule::PyModule(int majorVesion, int minorVersion) :
+    m_globalInterpreter(0),
+    m_pykdInit(false),
+    m_localPoolHits(0),
+    m_localPoolMisses(0),
+    m_localPoolRefillCount(0),
+    m_localPoolRefillTime(0),
+    m_teardownDeferred(0),
+    m_teardownDeferredTime(0),
+    m_teardownInline(0),
+    m_arena(0),
+    m_codeCacheHits(0),
+    m_codeCacheMisses(0),
+    m_sourceCacheHits(0),
+    m_sourceCacheMisses(0)
 {
+    PerfTimer  timer;
+
     m_handlePython = LoadPythonLibrary(majorVesion, minorVersion);
 
     if (!m_handlePython)
         throw std::exception("failed to load python module");
 
+    m_loadTime = timer.elapsed();
+
     isPy3 = majorVesion == 3;
+    majorVersion = majorVesion;
+    this->minorVersion = minorVersion;
+
+    // free-threaded builds ( python3Xt.dll ) split the count into a local and a shared part
+    if (GetProcAddress(m_handlePython, "_Py_DecRefShared"))
+        refcountMode = PyRefcountDispatch;
+    else if (!isPy3 || minorVersion < 12)
+        refcountMode = PyRefcountInline;
+    else if (minorVersion <= 14 && sizeof(void*) == 8)
+        refcountMode = PyRefcountInlineImmortal;
+    else
+        refcountMode = PyRefcountDispatch;
 
-    *reinterpret_cast<FARPROC*>(&PyType_Type) = GetProcAddress(m_handlePython, "PyType_Type");
-    *reinterpret_cast<FARPROC*>(&PyProperty_Type) = GetProcAddress(m_handlePython, "PyProperty_Type");
-    *reinterpret_cast<FARPROC*>(&PyUnicode_Type) = GetProcAddress(m_handlePython, "PyUnicode_Type");
-    *reinterpret_cast<FARPROC*>(&PyString_Type) = GetProcAddress(m_handlePython, "PyString_Type");
-    *reinterpret_cast<FARPROC*>(&PyBytes_Type) = isPy3 ? GetProcAddress(m_handlePython, "PyBytes_Type") : 0;
-
-    *reinterpret_cast<FARPROC*>(&Py_None) = GetProcAddress(m_handlePython, "_Py_NoneStruct");
-    PyExc_SystemExit = *reinterpret_cast<PyObject**>(GetProcAddress(m_handlePython, "PyExc_SystemExit"));
-    PyExc_TypeError= *reinterpret_cast<PyObject**>(GetProcAddress(m_handlePython, "PyExc_TypeError"));
-    PyThreadState_Current = reinterpret_cast<PyThreadState**>(GetProcAddress(m_handlePython, "_PyThreadState_Current"));
-    *reinterpret_cast<FARPROC*>(&Py_Initialize) = GetProcAddress(m_handlePython, "Py_Initialize");
-    *reinterpret_cast<FARPROC*>(&Py_Finalize) = GetProcAddress(m_handlePython, "Py_Finalize");
-    *reinterpret_cast<FARPROC*>(&Py_NewInterpreter) = GetProcAddress(m_handlePython, "Py_NewInterpreter");
-    *reinterpret_cast<FARPROC*>(&Py_EndInterpreter) = GetProcAddress(m_handlePython, "Py_EndInterpreter");
-    *reinterpret_cast<FARPROC*>(&Py_DecRef) = GetProcAddress(m_handlePython, "Py_DecRef");
-    *reinterpret_cast<FARPROC*>(&Py_IncRef) = GetProcAddress(m_handlePython, "Py_IncRef");
-    *reinterpret_cast<FARPROC*>(&PyEval_GetGlobals) = GetProcAddress(m_handlePython, "PyEval_GetGlobals");
-    *reinterpret_cast<FARPROC*>(&PyEval_InitThreads) = GetProcAddress(m_handlePython, "PyEval_InitThreads");
-    *reinterpret_cast<FARPROC*>(&PyEval_SaveThread) = GetProcAddress(m_handlePython, "PyEval_SaveThread");
-    *reinterpret_cast<FARPROC*>(&PyEval_RestoreThread) = GetProcAddress(m_handlePython, "PyEval_RestoreThread");
-    *reinterpret_cast<FARPROC*>(&PyThreadState_Swap) = GetProcAddress(m_handlePython, "PyThreadState_Swap");
-    *reinterpret_cast<FARPROC*>(&PyRun_String) = GetProcAddress(m_handlePython, "PyRun_String");
-    *reinterpret_cast<FARPROC*>(&PyRun_SimpleString) = GetProcAddress(m_handlePython, "PyRun_SimpleString");
-    *reinterpret_cast<FARPROC*>(&PyRun_File) = GetProcAddress(m_handlePython, "PyRun_File");
-    *reinterpret_cast<FARPROC*>(&PyRun_FileExFlags) = GetProcAddress(m_handlePython, "PyRun_FileExFlags");
-    *reinterpret_cast<FARPROC*>(&PyDict_New) = GetProcAddress(m_handlePython, "PyDict_New");
-    *reinterpret_cast<FARPROC*>(&PyDict_SetItemString) = GetProcAddress(m_handlePython, "PyDict_SetItemString");
-    *reinterpret_cast<FARPROC*>(&PyDict_GetItemString) = GetProcAddress(m_handlePython, "PyDict_GetItemString");
-    *reinterpret_cast<FARPROC*>(&PyDict_Clear) = GetProcAddress(m_handlePython, "PyDict_Clear");
-    *reinterpret_cast<FARPROC*>(&PyObject_Call) = GetProcAddress(m_handlePython, "PyObject_Call");
-    *reinterpret_cast<FARPROC*>(&PyObject_GetAttr) = GetProcAddress(m_handlePython, "PyObject_GetAttr");
-    *reinterpret_cast<FARPROC*>(&PyObject_GetAttrString) = GetProcAddress(m_handlePython, "PyObject_GetAttrString");
-    *reinterpret_cast<FARPROC*>(&PyObject_SetAttr) = GetProcAddress(m_handlePython, "PyObject_SetAttr");
-    *reinterpret_cast<FARPROC*>(&PyObject_CallObject) = GetProcAddress(m_handlePython, "PyObject_CallObject");
-    *reinterpret_cast<FARPROC*>(&PyObject_IsInstance) = GetProcAddress(m_handlePython, "PyObject_IsInstance");
-    *reinterpret_cast<FARPROC*>(&PyTuple_New) = GetProcAddress(m_handlePython, "PyTuple_New");
-    *reinterpret_cast<FARPROC*>(&PyTuple_SetItem) = GetProcAddress(m_handlePython, "PyTuple_SetItem");
-    *reinterpret_cast<FARPROC*>(&PyTuple_GetItem) = GetProcAddress(m_handlePython, "PyTuple_GetItem");
-    *reinterpret_cast<FARPROC*>(&PyTuple_Size) = GetProcAddress(m_handlePython, "PyTuple_Size");
-    *reinterpret_cast<FARPROC*>(&PyString_FromString) = GetProcAddress(m_handlePython, "PyString_FromString");
-    *reinterpret_cast<FARPROC*>(&PyCFunction_NewEx) = GetProcAddress(m_handlePython, "PyCFunction_NewEx");
-    *reinterpret_cast<FARPROC*>(&PySys_GetObject) = GetProcAddress(m_handlePython, "PySys_GetObject");
-    *reinterpret_cast<FARPROC*>(&PySys_SetObject) = GetProcAddress(m_handlePython, "PySys_SetObject");
-    *reinterpret_cast<FARPROC*>(&PySys_SetArgv) = !isPy3 ? GetProcAddress(m_handlePython, "PySys_SetArgv") : 0 ;
-    *reinterpret_cast<FARPROC*>(&PySys_SetArgv_Py3) = isPy3 ? GetProcAddress(m_handlePython, "PySys_SetArgv") : 0;
-    *reinterpret_cast<FARPROC*>(&PyString_FromString) = GetProcAddress(m_handlePython, "PyString_FromString");
-    *reinterpret_cast<FARPROC*>(&PyString_AsString) = GetProcAddress(m_handlePython, "PyString_AsString");
-    *reinterpret_cast<FARPROC*>(&PyBytes_AsString) = isPy3 ? GetProcAddress(m_handlePython, "PyBytes_AsString") : 0;
-    *reinterpret_cast<FARPROC*>(&PyErr_Fetch) = GetProcAddress(m_handlePython, "PyErr_Fetch");
-    *reinterpret_cast<FARPROC*>(&PyErr_NormalizeException) = GetProcAddress(m_handlePython, "PyErr_NormalizeException");
-    *reinterpret_cast<FARPROC*>(&PyErr_SetString) = GetProcAddress(m_handlePython, "PyErr_SetString");
-    *reinterpret_cast<FARPROC*>(&PyErr_Clear) = GetProcAddress(m_handlePython, "PyErr_Clear");
-    *reinterpret_cast<FARPROC*>(&PyImport_AddModule) = GetProcAddress(m_handlePython, "PyImport_AddModule");
-    *reinterpret_cast<FARPROC*>(&PyImport_ImportModule) = GetProcAddress(m_handlePython, "PyImport_ImportModule");
-    *reinterpret_cast<FARPROC*>(&PyImport_Cleanup) = GetProcAddress(m_handlePython, "PyImport_Cleanup");
-    *reinterpret_cast<FARPROC*>(&PyClass_New) = GetProcAddress(m_handlePython, "PyClass_New");
-    *reinterpret_cast<FARPROC*>(&PyInstance_New) = GetProcAddress(m_handlePython, "PyInstance_New");
-    *reinterpret_cast<FARPROC*>(&PyMethod_New) = GetProcAddress(m_handlePython, "PyMethod_New");
-    *reinterpret_cast<FARPROC*>(&PyCapsule_New) = GetProcAddress(m_handlePython, "PyCapsule_New");
-    *reinterpret_cast<FARPROC*>(&PyCapsule_GetPointer) = GetProcAddress(m_handlePython, "PyCapsule_GetPointer");
-    *reinterpret_cast<FARPROC*>(&PyObject_SetAttrString) = GetProcAddress(m_handlePython, "PyObject_SetAttrString");
-    *reinterpret_cast<FARPROC*>(&PyUnicode_FromWideChar) = isPy3 ? GetProcAddress(m_handlePython, "PyUnicode_FromWideChar") :
-         GetProcAddress(m_handlePython, "PyUnicodeUCS2_FromWideChar");
-    *reinterpret_cast<FARPROC*>(&PyUnicode_AsWideChar) = isPy3 ?  GetProcAddress(m_handlePython, "PyUnicode_AsWideChar") :
-         GetProcAddress(m_handlePython, "PyUnicodeUCS2_AsWideChar");
-    *reinterpret_cast<FARPROC*>(&PyImport_Import) = GetProcAddress(m_handlePython, "PyImport_Import");
-    *reinterpret_cast<FARPROC*>(&PyImport_AddModule) = GetProcAddress(m_handlePython, "PyImport_AddModule");
-    *reinterpret_cast<FARPROC*>(&PyBool_FromLong) = GetProcAddress(m_handlePython, "PyBool_FromLong");
-    *reinterpret_cast<FARPROC*>(&PyList_Size) = GetProcAddress(m_handlePython, "PyList_Size");
-    *reinterpret_cast<FARPROC*>(&PyList_GetItem) = GetProcAddress(m_handlePython, "PyList_GetItem");
-    *reinterpret_cast<FARPROC*>(&PyFile_FromString) = GetProcAddress(m_handlePython, "PyFile_FromString");
-    *reinterpret_cast<FARPROC*>(&PyFile_AsFile) = GetProcAddress(m_handlePython, "PyFile_AsFile");
-    *reinterpret_cast<FARPROC*>(&PyUnicode_FromString) = GetProcAddress(m_handlePython, "PyUnicode_FromString");
-    *reinterpret_cast<FARPROC*>(&PyInstanceMethod_New) = GetProcAddress(m_handlePython, "PyInstanceMethod_New");
-
-    *reinterpret_cast<FARPROC*>(&_Py_fopen_obj) = GetProcAddress(m_handlePython, "_Py_fopen_obj");
-    *reinterpret_cast<FARPROC*>(&Py_AddPendingCall) = GetProcAddress(m_handlePython, "Py_AddPendingCall");
-    *reinterpret_cast<FARPROC*>(&PyGILState_Ensure) = GetProcAddress(m_handlePython, "PyGILState_Ensure");
-    *reinterpret_cast<FARPROC*>(&PyGILState_Release) = GetProcAddress(m_handlePython, "PyGILState_Release");
-    *reinterpret_cast<FARPROC*>(&PyDescr_NewMethod) = GetProcAddress(m_handlePython, "PyDescr_NewMethod");
-    *reinterpret_cast<FARPROC*>(&PyGC_Collect) = GetProcAddress(m_handlePython, "PyGC_Collect");
-
-    *reinterpret_cast<FARPROC*>(&PyGILState_Check) = isPy3 ? GetProcAddress(m_handlePython, "PyGILState_Check") : 0;
+    timer.restart();
+
+    try
+    {
+        resolveApi();
+    }
+    catch (std::exception&)
+    {
+        FreeLibrary(m_handlePython);
+        throw;
+    }
+
+    m_resolveTime = timer.elapsed();
+
+    timer.restart();
+
+    const ManifestInterpreter*  manifestDesc = Manifest::get().findInterpreter(majorVesion, minorVersion);
+
+    if (manifestDesc && !manifestDesc->home.empty())
+    {
+        // python keeps the pointer, so the string lives in the module
+        m_home = manifestDesc->home;
+        m_homeW = std::wstring(_bstr_t(m_home.c_str()));
+
+        if (isPy3 && Py_SetPythonHome_Py3)
+            Py_SetPythonHome_Py3(const_cast<wchar_t*>(m_homeW.c_str()));
+        else if (!isPy3 && Py_SetPythonHome)
+            Py_SetPythonHome(const_cast<char*>(m_home.c_str()));
+    }
+
+    // python runs pending calls only on the thread which initialized it
+    m_initThreadId = GetCurrentThreadId();
 
-   
     Py_Initialize();
-    PyEval_InitThreads();
+
+    if (manifestDesc)
+        applyManifest(manifestDesc);
+
+    if (PyEval_InitThreads)
+        PyEval_InitThreads();
 
     checkPykd();
 
     m_globalState = PyEval_SaveThread();
+
+    m_initTime = timer.elapsed();
+}
+
+
+void PyModule::applyManifest(const ManifestInterpreter* desc)
+{
+    PyObject*  sysPath = PySys_GetObject("path");
+    if (!sysPath || !PyList_Insert)
+        return;
+
+    size_t  index = 0;
+
+    for (const std::string& path : desc->path)
+    {
+        PyObject*  pathObj = isPy3 ? PyUnicode_FromString(path.c_str()) : PyString_FromString(path.c_str());
+        if (!pathObj)
+            continue;
+
+        PyList_Insert(sysPath, index++, pathObj);
+        Py_DecRef(pathObj);
+    }
+
+    PyErr_Clear();
 }
 
 
@@ -533,6 +1271,15 @@ PyModule::~PyModule()
 
 void PyModule::deactivate()
 {
+    for (PythonInterpreter* interpreter : m_localPool)
+    {
+        delete interpreter;
+        PyThreadState_Swap(m_globalState);
+        m_globalState = PyEval_SaveThread();
+    }
+
+    m_localPool.clear();
+
     if (m_globalInterpreter)
     {
         delete m_globalInterpreter;
@@ -563,6 +1310,33 @@ void PyModule::deactivate()
     m_globalState = PyEval_SaveThread();
 }
 
+ObjectArena* PyModule::getArena()
+{
+    if (m_arena)
+        return m_arena;
+
+    // python 3.4 has PyMemAllocator without calloc
+    if (!isPy3 || minorVersion < 5 || !PyMem_GetAllocator || !PyMem_SetAllocator)
+        throw std::exception("the arena allocator requires python 3.5 or later\n");
+
+    int  reserveMb = Manifest::get().getIntOption("arenaReserve", sizeof(void*) == 8 ? 1024 : 256);
+    if (reserveMb <= 0)
+        reserveMb = 256;
+
+    std::unique_ptr<ObjectArena>  arena(new ObjectArena(static_cast<size_t>(reserveMb) * 0x100000));
+    if (!arena->isReserved())
+        throw std::exception("failed to reserve the arena address range\n");
+
+    PyMemAllocatorEx  fallback;
+    PyMem_GetAllocator(PYMEM_DOMAIN_OBJ, &fallback);
+
+    PyMemAllocatorEx  allocator = arena->wrap(fallback);
+    PyMem_SetAllocator(PYMEM_DOMAIN_OBJ, &allocator);
+
+    m_arena = arena.release();
+    return m_arena;
+}
+
 void PyModule::checkPykd()
 {
 
@@ -610,343 +1384,635 @@ void releaseInterpretor(PythonInterpreter* interpret)
     PythonSingleton::get()->releaseInterpretor(interpret);
 }
 
+void warmupInterpreter(int majorVersion, int minorVersion, const std::list<std::string>& modules)
+{
+    PythonSingleton::get()->warmupInterpreter(majorVersion, minorVersion, modules);
+}
+
+bool isPendingCallThread()
+{
+    return currentModule()->m_initThreadId == GetCurrentThreadId();
+}
+
+unsigned long getInterpreterThreadId()
+{
+    return PythonSingleton::get()->currentInterpreter()->m_threadId;
+}
+
+PyObject* getInterpreterObject(const std::string& key)
+{
+    PythonInterpreter*  interpreter = PythonSingleton::get()->currentInterpreter();
+    if (!interpreter)
+        return NULL;
+
+    auto  it = interpreter->m_objects.find(key);
+    return it != interpreter->m_objects.end() ? it->second : NULL;
+}
+
+void setInterpreterObject(const std::string& key, PyObject* obj)
+{
+    PythonInterpreter*  interpreter = PythonSingleton::get()->currentInterpreter();
+    if (!interpreter)
+        return;
+
+    PyObject*&  slot = interpreter->m_objects[key];
+
+    Py_IncRef(obj);
+    if (slot)
+        Py_DecRef(slot);
+    slot = obj;
+}
+
+PyObject* compileScriptFile(const std::string& path, MappedFile& file)
+{
+    PythonInterpreter*  interpreter = PythonSingleton::get()->currentInterpreter();
+    PyModule*  module = interpreter->m_module;
+
+    if (!file.isOpen())
+        throw std::invalid_argument("Unable to open script\n");
+
+    unsigned long long  size = file.size();
+    unsigned long long  writeTime = file.writeTime();
+
+    auto  it = interpreter->m_scripts.find(path);
+    if (it != interpreter->m_scripts.end())
+    {
+        if (it->second.size == size && it->second.writeTime == writeTime)
+        {
+            ++module->m_codeCacheHits;
+            Py_IncRef(it->second.code);
+            return it->second.code;
+        }
+
+        Py_DecRef(it->second.code);
+        interpreter->m_scripts.erase(it);
+    }
+
+    ++module->m_codeCacheMisses;
+
+    PyObject*  code = Py_CompileString(file.c_str(), path.c_str(), Py_file_input);
+    if (!code)
+        return NULL;
+
+    Py_IncRef(code);
+    interpreter->m_scripts[path] = { size, writeTime, code };
+
+    return code;
+}
+
+// code objects kept by every interpreter for -c and -e, 0 disables the cache
+static size_t sourceCacheSize()
+{
+    int  size = Manifest::get().getIntOption("sourceCache", 64);
+    return size > 0 ? static_cast<size_t>(size) : 0;
+}
+
+PyObject* compileSourceString(const std::string& source, int start)
+{
+    PythonInterpreter*  interpreter = PythonSingleton::get()->currentInterpreter();
+    PyModule*  module = interpreter->m_module;
+
+    std::string  key = (start == Py_eval_input ? "eval:" : "exec:") + source;
+
+    auto  it = interpreter->m_sourceIndex.find(key);
+    if (it != interpreter->m_sourceIndex.end())
+    {
+        ++module->m_sourceCacheHits;
+
+        // the list iterator stays valid when the entry is moved
+        interpreter->m_sources.splice(interpreter->m_sources.begin(), interpreter->m_sources, it->second);
+
+        Py_IncRef(it->second->second);
+        return it->second->second;
+    }
+
+    ++module->m_sourceCacheMisses;
+
+    PyObject*  code = Py_CompileString(source.c_str(), "<string>", start);
+    if (!code)
+        return NULL;
+
+    size_t  cacheSize = sourceCacheSize();
+    if (cacheSize == 0)
+        return code;
+
+    while (interpreter->m_sources.size() >= cacheSize)
+    {
+        Py_DecRef(interpreter->m_sources.back().second);
+        interpreter->m_sourceIndex.erase(interpreter->m_sources.back().first);
+        interpreter->m_sources.pop_back();
+    }
+
+    Py_IncRef(code);
+    interpreter->m_sources.emplace_front(key, code);
+    interpreter->m_sourceIndex[key] = interpreter->m_sources.begin();
+
+    return code;
+}
+
 bool isInterpreterLoaded(int majorVersion, int minorVersion)
 {
     return PythonSingleton::get()->isInterpreterLoaded(majorVersion, minorVersion);
 }
 
+bool getInterpreterLoadInfo(int majorVersion, int minorVersion, InterpreterLoadInfo& info)
+{
+    PyModule*  module = PythonSingleton::get()->getLoadedModule(majorVersion, minorVersion);
+    if (!module)
+        return false;
+
+    info.loadTime = module->m_loadTime;
+    info.resolveTime = module->m_resolveTime;
+    info.initTime = module->m_initTime;
+    info.initByCaller = module->m_initThreadId == GetCurrentThreadId();
+    info.apiResolved = module->m_apiAvailable.count();
+    info.apiUnavailable.clear();
+
+    for (size_t i = 0; i < PythonApiCount; ++i)
+    {
+        if (!module->m_apiAvailable.test(i))
+            info.apiUnavailable.push_back(pythonApiDesc[i].name);
+    }
+
+    PythonSingleton::get()->getLocalPoolInfo(module, info);
+
+    info.codeCacheHits = module->m_codeCacheHits;
+    info.codeCacheMisses = module->m_codeCacheMisses;
+    info.sourceCacheHits = module->m_sourceCacheHits;
+    info.sourceCacheMisses = module->m_sourceCacheMisses;
+
+    info.arenaCommitted = module->m_arena ? module->m_arena->committed() : 0;
+    info.arenaPeak = module->m_arena ? module->m_arena->peak() : 0;
+
+    return true;
+}
+
+void setArenaActive(bool active)
+{
+    currentModule()->getArena()->setActive(active);
+}
+
+size_t getArenaRunPeak()
+{
+    ObjectArena*  arena = currentModule()->m_arena;
+    return arena ? arena->runPeak() : 0;
+}
+
+void getReleaseInfo(double& time, bool& deferred)
+{
+    PythonSingleton::get()->getReleaseInfo(time, deferred);
+}
+
 void stopAllInterpreter()
 {
     PythonSingleton::get()->stopAllInterpreter();
 }
 
-void Py_IncRef(PyObject* object)
+void PyIncRefDispatch(PyObject* object)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->Py_IncRef(object);
+    currentModule()->Py_IncRef(object);
 }
 
-void Py_DecRef(PyObject* object)
+void PyDecRefDispatch(PyObject* object)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->Py_DecRef(object);
+    currentModule()->Py_DecRef(object);
 }
 
 PyObject* PyString_FromString(const char *v)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyString_FromString(v);
+    return currentModule(PythonApi_PyString_FromString)->PyString_FromString(v);
 }
 
 PyObject* PyDict_New()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyDict_New();
+    return currentModule()->PyDict_New();
 }
 
 PyObject* PyDict_GetItemString(PyObject *p, const char *key)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyDict_GetItemString(p, key);
+    return currentModule(PythonApi_PyDict_GetItemString)->PyDict_GetItemString(p, key);
 }
 
 int  PyDict_SetItemString(PyObject *p, const char *key, PyObject *val)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyDict_SetItemString(p, key, val);
+    return currentModule(PythonApi_PyDict_SetItemString)->PyDict_SetItemString(p, key, val);
 }
 
 void  PyDict_Clear(PyObject *p)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyDict_Clear(p);
+    return currentModule()->PyDict_Clear(p);
+}
+
+PyObject* PyDict_Copy(PyObject *p)
+{
+    return currentModule()->PyDict_Copy(p);
 }
 
 PyObject*  PyCFunction_NewEx(PyMethodDef* pydef, PyObject *p1, PyObject *p2)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyCFunction_NewEx(pydef, p1, p2);
+    return currentModule()->PyCFunction_NewEx(pydef, p1, p2);
 }
 
 PyObject*  PyClass_New(PyObject* className, PyObject* classBases, PyObject* classDict)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyClass_New(className, classBases, classDict);
+    return currentModule(PythonApi_PyClass_New)->PyClass_New(className, classBases, classDict);
 }
 
 PyObject*  PyMethod_New(PyObject *func, PyObject *self, PyObject *classobj)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyMethod_New(func, self, classobj);
+    return currentModule()->PyMethod_New(func, self, classobj);
 }
 
 int  PySys_SetObject(char *name, PyObject *v)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PySys_SetObject(name, v);
+    return currentModule()->PySys_SetObject(name, v);
 }
 
 void  PySys_SetArgv(int argc, char **argv)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PySys_SetArgv(argc, argv);
+    currentModule(PythonApi_PySys_SetArgv)->PySys_SetArgv(argc, argv);
 }
 
 void  PySys_SetArgv_Py3(int argc, wchar_t **argv)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PySys_SetArgv_Py3(argc, argv);
+    currentModule(PythonApi_PySys_SetArgv_Py3)->PySys_SetArgv_Py3(argc, argv);
 }
 
 PyObject*  PySys_GetObject(char *name)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PySys_GetObject(name);
+    return currentModule()->PySys_GetObject(name);
 }
 
 PyObject*  PyInstance_New(PyObject *classobj, PyObject *arg, PyObject *kw)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyInstance_New(classobj, arg, kw);
+    return currentModule(PythonApi_PyInstance_New)->PyInstance_New(classobj, arg, kw);
 }
 
 int  PyRun_SimpleString(const char* str)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyRun_SimpleString(str);
+    return currentModule(PythonApi_PyRun_SimpleString)->PyRun_SimpleString(str);
 }
 
 PyObject*  PyRun_String(const char *str, int start, PyObject *globals, PyObject *locals)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyRun_String(str, start, globals, locals);
+    return currentModule()->PyRun_String(str, start, globals, locals);
+}
+
+PyObject* Py_CompileString(const char *str, const char *filename, int start)
+{
+    return currentModule()->Py_CompileString(str, filename, start);
+}
+
+PyObject* PyEval_EvalCode(PyObject *co, PyObject *globals, PyObject *locals)
+{
+    return currentModule()->PyEval_EvalCode(co, globals, locals);
 }
 
 PyObject*  PyCapsule_New(void *pointer, const char *name, PyCapsule_Destructor destructor)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyCapsule_New(pointer, name, destructor);
+    return currentModule()->PyCapsule_New(pointer, name, destructor);
 }
 
 void*  PyCapsule_GetPointer(PyObject *capsule, const char *name)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyCapsule_GetPointer(capsule, name);
+    return currentModule()->PyCapsule_GetPointer(capsule, name);
 }
 
 int  PyObject_SetAttrString(PyObject *o, const char *attr_name, PyObject *v)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_SetAttrString(o, attr_name, v);
+    return currentModule()->PyObject_SetAttrString(o, attr_name, v);
 }
 
 PyObject*  PyObject_GetAttrString(PyObject *o, const char *attr_name)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_GetAttrString(o, attr_name);
+    return currentModule()->PyObject_GetAttrString(o, attr_name);
 }
 
 PyObject*  PyObject_CallObject(PyObject *callable_object, PyObject *args)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_CallObject(callable_object, args);
+    return currentModule()->PyObject_CallObject(callable_object, args);
 }
 
 PyObject*  PyObject_Call(PyObject *callable_object, PyObject *args, PyObject *kw)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_Call(callable_object, args, kw);
+    return currentModule()->PyObject_Call(callable_object, args, kw);
 }
 
 int PyObject_IsInstance(PyObject *inst, PyObject *cls)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_IsInstance(inst,cls);
+    return currentModule()->PyObject_IsInstance(inst,cls);
+}
+
+size_t PyObject_Size(PyObject *o)
+{
+    return currentModule()->PyObject_Size(o);
 }
 
 PyObject*  PyTuple_New(size_t len)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyTuple_New(len);
+    return currentModule()->PyTuple_New(len);
 }
 
 PyObject*  PyTuple_GetItem(PyObject *p, size_t pos)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyTuple_GetItem(p, pos);
+    return currentModule()->PyTuple_GetItem(p, pos);
 }
 
 int  PyTuple_SetItem(PyObject *p, size_t pos, PyObject *obj)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyTuple_SetItem(p, pos, obj);
+    return currentModule()->PyTuple_SetItem(p, pos, obj);
 }
 
 size_t  PyTuple_Size(PyObject *p)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyTuple_Size(p);
+    return currentModule()->PyTuple_Size(p);
 }
 
 char*  PyString_AsString(PyObject *string)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyString_AsString(string);
+    return currentModule(PythonApi_PyString_AsString)->PyString_AsString(string);
 }
 
 char*  PyBytes_AsString(PyObject *bytes)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyBytes_AsString(bytes);
+    return currentModule(PythonApi_PyBytes_AsString)->PyBytes_AsString(bytes);
+}
+
+size_t  PyString_Size(PyObject *string)
+{
+    return currentModule(PythonApi_PyString_Size)->PyString_Size(string);
+}
+
+size_t  PyBytes_Size(PyObject *bytes)
+{
+    return currentModule(PythonApi_PyBytes_Size)->PyBytes_Size(bytes);
 }
 
 PyObject* PyUnicode_FromWideChar(const wchar_t *w, size_t size)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyUnicode_FromWideChar(w, size);
+    return currentModule()->PyUnicode_FromWideChar(w, size);
 }
 
 PyObject*  PyImport_Import(PyObject *name)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyImport_Import(name);
+    return currentModule()->PyImport_Import(name);
 }
 
 PyObject*  PyBool_FromLong(long v)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyBool_FromLong(v);
+    return currentModule()->PyBool_FromLong(v);
+}
+
+int  PyObject_IsTrue(PyObject *o)
+{
+    return currentModule()->PyObject_IsTrue(o);
+}
+
+long long  PyLong_AsLongLong(PyObject *o)
+{
+    return currentModule()->PyLong_AsLongLong(o);
+}
+
+unsigned long long  PyLong_AsUnsignedLongLong(PyObject *o)
+{
+    return currentModule()->PyLong_AsUnsignedLongLong(o);
+}
+
+PyObject*  PyLong_FromLongLong(long long v)
+{
+    return currentModule()->PyLong_FromLongLong(v);
+}
+
+PyObject*  PyLong_FromUnsignedLongLong(unsigned long long v)
+{
+    return currentModule()->PyLong_FromUnsignedLongLong(v);
+}
+
+PyObject*  PyString_FromStringAndSize(const char *v, size_t len)
+{
+    return currentModule(PythonApi_PyString_FromStringAndSize)->PyString_FromStringAndSize(v, len);
+}
+
+PyObject*  PyBytes_FromStringAndSize(const char *v, size_t len)
+{
+    return currentModule(PythonApi_PyBytes_FromStringAndSize)->PyBytes_FromStringAndSize(v, len);
+}
+
+int  PyObject_GetBuffer(PyObject *obj, Py_buffer *view, int flags)
+{
+    return currentModule()->PyObject_GetBuffer(obj, view, flags);
+}
+
+void  PyBuffer_Release(Py_buffer *view)
+{
+    currentModule()->PyBuffer_Release(view);
 }
 
 PyObject* Py_None()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->Py_None;
+    return currentModule()->Py_None;
 }
 
 PyObject* PyExc_SystemExit()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyExc_SystemExit;
+    return currentModule()->PyExc_SystemExit;
 }
 
 PyObject* PyExc_TypeError()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyExc_TypeError;
+    return currentModule()->PyExc_TypeError;
 }
 
 PyObject* PyType_Type()
 {
-    return  PythonSingleton::get()->currentInterpreter()->m_module->PyType_Type;
+    return  currentModule()->PyType_Type;
 }
 
 PyObject* PyProperty_Type()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyProperty_Type;
+    return currentModule()->PyProperty_Type;
 }
 
 void PyErr_Fetch(PyObject **ptype, PyObject **pvalue, PyObject **ptraceback)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PyErr_Fetch(ptype, pvalue, ptraceback);
+    currentModule()->PyErr_Fetch(ptype, pvalue, ptraceback);
 }
 
 
 void PyErr_NormalizeException(PyObject**exc, PyObject**val, PyObject**tb)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PyErr_NormalizeException(exc, val, tb);
+    currentModule()->PyErr_NormalizeException(exc, val, tb);
 }
 
 void PyErr_Clear()
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PyErr_Clear();
+    currentModule()->PyErr_Clear();
+}
+
+PyObject* PyErr_Occurred()
+{
+    return currentModule()->PyErr_Occurred();
 }
 
 void PyErr_SetString(PyObject *type, const char *message)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PyErr_SetString(type, message);
+    currentModule()->PyErr_SetString(type, message);
 }
 
 size_t  PyList_Size(PyObject* list)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyList_Size(list);
+    return currentModule()->PyList_Size(list);
 }
 
 PyObject*  PyList_GetItem(PyObject *list, size_t index)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyList_GetItem(list, index);
+    return currentModule()->PyList_GetItem(list, index);
 }
 
-PyObject*  PyFile_FromString(char *filename, char *mode)
+
+PyObject*  PyUnicode_FromString(const char*  str)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyFile_FromString(filename, mode);
+    return currentModule(PythonApi_PyUnicode_FromString)->PyUnicode_FromString(str);
 }
 
-FILE*  PyFile_AsFile(PyObject *pyfile)
+PyObject*  PyInstanceMethod_New(PyObject *func)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyFile_AsFile(pyfile);
+    return currentModule(PythonApi_PyInstanceMethod_New)->PyInstanceMethod_New(func);
 }
 
-PyObject*  PyRun_File(FILE *fp, const char *filename, int start, PyObject *globals, PyObject *locals)
+size_t  PyUnicode_AsWideChar(PyObject *unicode, wchar_t *w, size_t size)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyRun_File(fp, filename, start, globals, locals);
+    return currentModule()->PyUnicode_AsWideChar(unicode, w, size);
 }
 
-PyObject* PyRun_FileExFlags(FILE *fp, const char *filename, int start, PyObject *globals, PyObject *locals, int closeit, void *flags)
+PyObject*  PyImport_ImportModule(const char *name)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyRun_FileExFlags(fp, filename, start, globals, locals, closeit, flags);
+    return currentModule()->PyImport_ImportModule(name);
 }
 
+PyObject*  PyImport_AddModule(const char *name)
+{
+    return currentModule(PythonApi_PyImport_AddModule)->PyImport_AddModule(name);
+}
 
-PyObject*  PyUnicode_FromString(const char*  str)
+PyThreadState*  PyEval_SaveThread()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyUnicode_FromString(str);
+    return currentModule()->PyEval_SaveThread();
 }
 
-PyObject*  PyInstanceMethod_New(PyObject *func)
+void  PyEval_RestoreThread(PyThreadState *tstate)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyInstanceMethod_New(func);
+    currentModule()->PyEval_RestoreThread(tstate);
 }
 
-size_t  PyUnicode_AsWideChar(PyObject *unicode, wchar_t *w, size_t size)
+PyThreadState*  PyThreadState_Get()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyUnicode_AsWideChar(unicode, w, size);
+    return currentModule()->PyThreadState_Get();
 }
 
-PyObject*  PyImport_ImportModule(const char *name)
+PyThreadState*  PyThreadState_New(PyInterpreterState *interp)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyImport_ImportModule(name);
+    return currentModule()->PyThreadState_New(interp);
 }
 
-PyObject*  PyImport_AddModule(const char *name)
+void  PyThreadState_Clear(PyThreadState *tstate)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyImport_AddModule(name);
+    currentModule()->PyThreadState_Clear(tstate);
 }
 
-PyThreadState*  PyEval_SaveThread()
+void  PyThreadState_Delete(PyThreadState *tstate)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyEval_SaveThread();
+    currentModule()->PyThreadState_Delete(tstate);
 }
 
-void  PyEval_RestoreThread(PyThreadState *tstate)
+int  PyThreadState_SetAsyncExc(unsigned long id, PyObject *exc)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PyEval_RestoreThread(tstate);
+    return currentModule()->PyThreadState_SetAsyncExc(id, exc);
 }
 
-FILE* _Py_fopen_obj(PyObject *pyfile, const char* mode)
+PyInterpreterState*  PyThreadState_GetInterpreter(PyThreadState *tstate)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->_Py_fopen_obj(pyfile, mode);
+    PyModule*  module = currentModule();
+
+    if (module->PyThreadState_GetInterpreter)
+        return module->PyThreadState_GetInterpreter(tstate);
+
+    // before 3.9 the field follows the thread list links: next ( and prev since 3.4 )
+    size_t  interpField = module->isPy3 && module->minorVersion >= 4 ? 2 : 1;
+    return reinterpret_cast<PyInterpreterState**>(tstate)[interpField];
 }
 
 int  Py_AddPendingCall(int(*func)(void *), void *arg)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->Py_AddPendingCall(func, arg);
+    return currentModule()->Py_AddPendingCall(func, arg);
 }
 
 PyGILState_STATE  PyGILState_Ensure()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyGILState_Ensure();
+    return currentModule()->PyGILState_Ensure();
 }
 
 void  PyGILState_Release(PyGILState_STATE state)
 {
-    PythonSingleton::get()->currentInterpreter()->m_module->PyGILState_Release(state);
+    currentModule()->PyGILState_Release(state);
 }
 
 PyObject*  PyDescr_NewMethod(PyObject* type, struct PyMethodDef *meth)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyDescr_NewMethod(type, meth);
+    return currentModule(PythonApi_PyDescr_NewMethod)->PyDescr_NewMethod(type, meth);
+}
+
+PyObject*  PyType_FromSpec(PyType_Spec *spec)
+{
+    return currentModule(PythonApi_PyType_FromSpec)->PyType_FromSpec(spec);
+}
+
+PyObject*  PyType_GenericAlloc(PyObject *type, size_t nitems)
+{
+    return currentModule()->PyType_GenericAlloc(type, nitems);
+}
+
+void*  PyType_GetSlot(PyObject *type, int slot)
+{
+    // python 3.4+, callers fall back to the defaults when it is not available
+    PyModule*  module = currentModule();
+    return module->PyType_GetSlot ? module->PyType_GetSlot(type, slot) : NULL;
+}
+
+void  PyObject_Free(void *p)
+{
+    currentModule()->PyObject_Free(p);
 }
 
 size_t  PyGC_Collect(void)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyGC_Collect();
+    return currentModule(PythonApi_PyGC_Collect)->PyGC_Collect();
 }
 
 bool IsPy3()
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->isPy3;
+    return currentModule()->isPy3;
+}
+
+int PyMinorVersion()
+{
+    return currentModule()->minorVersion;
 }
 
 int  PyString_Check(PyObject *o)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_IsInstance(o,
-        PythonSingleton::get()->currentInterpreter()->m_module->PyString_Type );
+    PyModule*  module = currentModule(PythonApi_PyString_Type);
+    return module->PyObject_IsInstance(o, module->PyString_Type);
 }
 
 int  PyUnicode_Check(PyObject *o)
 {
-    return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_IsInstance(o,
-        PythonSingleton::get()->currentInterpreter()->m_module->PyUnicode_Type );
+    PyModule*  module = currentModule();
+    return module->PyObject_IsInstance(o, module->PyUnicode_Type);
 }
 
 int  PyBytes_Check(PyObject *o)
 {
-return PythonSingleton::get()->currentInterpreter()->m_module->PyObject_IsInstance(o,
-    PythonSingleton::get()->currentInterpreter()->m_module->PyBytes_Type);
+    PyModule*  module = currentModule(PythonApi_PyBytes_Type);
+    return module->PyObject_IsInstance(o, module->PyBytes_Type);
 }
-
@@ -6,6 +6,7 @@
 #include "pymodule.h"
 
 class PythonInterpreter;
+class MappedFile;
 
 PythonInterpreter*  activateInterpreter(bool global = true, int majorVersion = -1, int minorVersion = -1);
 
@@ -35,8 +36,66 @@ void getDefaultInterpreter(int majorVersion, int minorVersion);
 
 bool isInterpreterLoaded(int majorVersion, int minorVersion);
 
+void warmupInterpreter(int majorVersion, int minorVersion, const std::list<std::string>& modules);
+
+bool isPendingCallThread();
+
+unsigned long getInterpreterThreadId();
+
+// objects kept by the active interpreter until it ends ( class objects, resident streams )
+PyObject* getInterpreterObject(const std::string& key);
+
+void setInterpreterObject(const std::string& key, PyObject* obj);
+
+// Code object of the script file, compiled once per interpreter and taken from its
+// cache while the file size and last write time stay the same. NULL with the python
+// error set when the compilation fails. The file is the open script, the caller
+// may have read its preamble already.
+PyObject* compileScriptFile(const std::string& path, MappedFile& file);
+
+// Code object of the -c ( Py_file_input ) or -e ( Py_eval_input ) source, kept by
+// the interpreter in a bounded cache keyed by the mode and the source text.
+PyObject* compileSourceString(const std::string& source, int start);
+
+struct InterpreterLoadInfo {
+    double  loadTime;       // ms, image load
+    double  resolveTime;    // ms, C API table resolution
+    double  initTime;       // ms, Py_Initialize and pykd initialization
+    bool  initByCaller;     // Py_Initialize ran on the calling ( command ) thread, not the preload one
+    size_t  apiResolved;
+    std::list<std::string>  apiUnavailable;
+    size_t  localPoolReady;         // sub-interpreters waiting for --local
+    size_t  localPoolHits;
+    size_t  localPoolMisses;
+    size_t  localPoolRefillCount;   // interpreters created by the last refill
+    double  localPoolRefillTime;    // ms, the last refill
+    size_t  teardownPending;        // --local interpreters waiting for the background teardown
+    size_t  teardownDeferred;
+    double  teardownDeferredTime;   // ms, all background teardowns
+    size_t  teardownInline;         // ended by the command itself: the queue was full
+    size_t  codeCacheHits;          // script runs which took the compiled code from the interpreter
+    size_t  codeCacheMisses;
+    size_t  sourceCacheHits;        // -c and -e runs which took the compiled code from the interpreter
+    size_t  sourceCacheMisses;
+    size_t  arenaCommitted;         // bytes, 0 without --arena
+    size_t  arenaPeak;
+};
+
+bool getInterpreterLoadInfo(int majorVersion, int minorVersion, InterpreterLoadInfo& info);
+
+// time spent by the last interpreter release, the --local interpreter teardown is not
+// included when it was deferred
+void getReleaseInfo(double& time, bool& deferred);
+
 void stopAllInterpreter();
 
+// arena for the object allocator of the current interpreter ( see arena.h ),
+// installed at the first activation
+void setArenaActive(bool active);
+
+// bytes committed by the arena at most since it was activated last time
+size_t getArenaRunPeak();
+
 void checkPykd();
 
 
@@ -63,6 +122,31 @@ private:
 };
 
 
+class AutoArena
+{
+public:
+
+    explicit AutoArena(bool enable) :
+        m_enabled(enable)
+    {
+        if (m_enabled)
+            setArenaActive(true);
+    }
+
+    ~AutoArena()
+    {
+        if (m_enabled)
+            setArenaActive(false);
+    }
+
+private:
+
+    AutoArena(const AutoArena&) = delete;
+
+    bool  m_enabled;
+};
+
+
 
 
 
@@ -4,7 +4,36 @@
 
 #include "pyapi.h"
 
+//////////////////////////////////////////////////////////////////////////////
 
+#define PYAPI_REQUIRED  true
+#define PYAPI_OPTIONAL  false
 
+enum PythonApi {
 
+#define PYTHON_API_DATA(type, name, py2Export, py3Export, required) PythonApi_##name,
+#define PYTHON_API_DATA_PTR(name, py2Export, py3Export, required) PythonApi_##name,
+#define PYTHON_API_FUNC(ret, name, args, py2Export, py3Export, required) PythonApi_##name,
+#include "pyapitable.h"
+#undef PYTHON_API_DATA
+#undef PYTHON_API_DATA_PTR
+#undef PYTHON_API_FUNC
 
+    PythonApiCount
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+struct PyApiTable {
+
+#define PYTHON_API_DATA(type, name, py2Export, py3Export, required) type name;
+#define PYTHON_API_DATA_PTR(name, py2Export, py3Export, required) PyObject* name;
+#define PYTHON_API_FUNC(ret, name, args, py2Export, py3Export, required) ret (*name) args;
+#include "pyapitable.h"
+#undef PYTHON_API_DATA
+#undef PYTHON_API_DATA_PTR
+#undef PYTHON_API_FUNC
+
+};
+
+//////////////////////////////////////////////////////////////////////////////
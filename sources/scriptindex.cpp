@@ -0,0 +1,109 @@
+#include "stdafx.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "scriptindex.h"
+#include "manifest.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+std::string toLower(const std::string& str)
+{
+    std::string  lower(str);
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+    return lower;
+}
+
+} // anonymous namespace
+
+//////////////////////////////////////////////////////////////////////////////
+
+ScriptIndex& ScriptIndex::get()
+{
+    static ScriptIndex  index;
+    return index;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+ScriptIndex::ScriptIndex()
+{
+    for (const std::string& path : Manifest::get().getPathListOption("scriptPath"))
+    {
+        Directory  dir;
+        dir.path = path;
+        while (!dir.path.empty() && (dir.path.back() == '\\' || dir.path.back() == '/'))
+            dir.path.pop_back();
+        if (dir.path.empty())
+            continue;
+
+        dir.listed = false;
+        dir.notification = FindFirstChangeNotificationA(path.c_str(), FALSE, FILE_NOTIFY_CHANGE_FILE_NAME);
+
+        m_directories.push_back(dir);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+ScriptIndex::~ScriptIndex()
+{
+    for (Directory& dir : m_directories)
+    {
+        if (dir.notification != INVALID_HANDLE_VALUE)
+            FindCloseChangeNotification(dir.notification);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+std::string ScriptIndex::find(const std::string& fileName)
+{
+    std::string  key = toLower(fileName);
+
+    for (Directory& dir : m_directories)
+    {
+        refresh(dir);
+
+        auto  it = dir.files.find(key);
+        if (it != dir.files.end())
+            return dir.path + '\\' + it->second;
+    }
+
+    return "";
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void ScriptIndex::refresh(Directory& dir)
+{
+    if (dir.notification != INVALID_HANDLE_VALUE)
+    {
+        if (dir.listed && WaitForSingleObject(dir.notification, 0) != WAIT_OBJECT_0)
+            return;
+
+        // rearm before the listing: a change made during it fires again
+        if (dir.listed)
+            FindNextChangeNotification(dir.notification);
+    }
+
+    dir.files.clear();
+    dir.listed = true;
+
+    WIN32_FIND_DATAA  findData;
+    HANDLE  findHandle = FindFirstFileA((dir.path + "\\*").c_str(), &findData);
+    if (findHandle == INVALID_HANDLE_VALUE)
+        return;
+
+    do {
+        if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+            dir.files[toLower(findData.cFileName)] = findData.cFileName;
+    } while (FindNextFileA(findHandle, &findData));
+
+    FindClose(findHandle);
+}
+
+//////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Windows.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// In-memory listing of the script directories given by the manifest option
+// scriptPath. A directory is listed again only after its change notification
+// fires ( or on every lookup when notifications are not available, e.g. for
+// some network redirectors ), so resolving a script name is a hash lookup per
+// directory instead of a SearchPath over the whole PATH.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+class ScriptIndex
+{
+public:
+
+    static ScriptIndex& get();
+
+    bool isEnabled() const {
+        return !m_directories.empty();
+    }
+
+    // full path of the first file with this name ( case insensitive ) in the
+    // directory order of the manifest, "" when there is none
+    std::string find(const std::string& fileName);
+
+private:
+
+    struct Directory {
+        std::string  path;
+        HANDLE  notification;
+        bool  listed;
+        // lower case name -> name as stored
+        std::unordered_map<std::string, std::string>  files;
+    };
+
+    ScriptIndex();
+
+    ~ScriptIndex();
+
+    ScriptIndex(const ScriptIndex&) = delete;
+
+    void refresh(Directory& dir);
+
+    std::vector<Directory>  m_directories;
+};
+
+//////////////////////////////////////////////////////////////////////////////
@@ -3,9 +3,7 @@
 #include <algorithm>
 #include <sstream>
 #include <string>
-#include <fstream>
 #include <iomanip> 
-#include <regex>
 
 #include <DbgEng.h>
 
@@ -15,80 +13,104 @@
 #include "pyapi.h"
 #include "pyclass.h"
 #include "version.h"
+#include "perftimer.h"
+#include "manifest.h"
+#include "scriptindex.h"
+#include "preamble.h"
+#include "mappedfile.h"
+#include "interruptwatch.h"
 
 //////////////////////////////////////////////////////////////////////////////
 
 static int  defaultMajorVersion = -1;
 static int  defaultMinorVersion = -1;
 
+// interpreter discovery and optional preload started by DebugExtensionInitialize
+static HANDLE  startupThread = NULL;
+static HANDLE  discoveryEvent = NULL;
+
+// host kind, found once by DebugExtensionInitialize
+static bool  classicWindbg = false;
+
+static PerfTimer  startupTimer;
+static double  extensionReadyTime = -1.0;
+static double  discoveryDoneTime = -1.0;
+static double  warmupDoneTime = -1.0;
+static double  firstPromptTime = -1.0;
+
 //////////////////////////////////////////////////////////////////////////////
 
 void handleException();
+PyObject* getIsolatedNamespace(PyObject* mainGlobals, bool importPykd);
+PyObject* runScriptFile(const std::string& path, MappedFile& file, const ScriptPreamble& preamble, PyObject* globals);
+PyObject* runSourceString(const std::string& source, bool eval, PyObject* globals);
 std::string getScriptFileName(const std::string &scriptName);
 void getPythonVersion(int&  majorVersion, int& minorVersion);
 void getDefaultPythonVersion(int& majorVersion, int& minorVersion);
+void findDefaultPythonVersion(int& majorVersion, int& minorVersion);
+void waitInterpreterDiscovery();
+void waitInterpreterWarmup();
+bool isInterpreterWarmupRunning();
 void printString(PDEBUG_CLIENT client, ULONG mask, const char* str);
 
 //////////////////////////////////////////////////////////////////////////////
 
-class InterruptWatch
+static void discoverInterpreter()
 {
-public:
-
-    InterruptWatch(PDEBUG_CLIENT client)
+    try
     {
-        m_control = client;
-        m_stopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-        m_thread = CreateThread(NULL, 0, threadRoutine, this, 0, NULL);
-    }
+        Manifest::get().getDefaultVersion(defaultMajorVersion, defaultMinorVersion);
 
-    ~InterruptWatch()
-    {
-        SetEvent(m_stopEvent);
-        WaitForSingleObject(m_thread, INFINITE);
-        CloseHandle(m_stopEvent);
-        CloseHandle(m_thread);
-    }
+        int  majorVersion, minorVersion;
+        findDefaultPythonVersion(majorVersion, minorVersion);
 
-    static int quit(void *context)
-    {
-        HANDLE   quitEvent = (HANDLE)context;
-        PyErr_SetString(PyExc_SystemExit(), "CTRL+BREAK");
-        SetEvent(quitEvent);
-        return -1;
+        defaultMajorVersion = majorVersion;
+        defaultMinorVersion = minorVersion;
     }
+    catch (std::exception&)
+    {}
 
-private:
+    discoveryDoneTime = startupTimer.elapsed();
+}
 
-    static DWORD WINAPI threadRoutine(LPVOID lpParameter) {
-        return  static_cast<InterruptWatch*>(lpParameter)->interruptWatchRoutine();
-    }
+static DWORD WINAPI startupRoutine(LPVOID)
+{
+    discoverInterpreter();
+
+    SetEvent(discoveryEvent);
+
+    const Manifest&  manifest = Manifest::get();
 
-    DWORD InterruptWatch::interruptWatchRoutine()
+    if (manifest.getIntOption("preload", 0) != 0 && defaultMajorVersion != -1)
     {
-        while (WAIT_TIMEOUT == WaitForSingleObject(m_stopEvent, 250))
+        try
         {
-            HRESULT  hres = m_control->GetInterrupt();
-            if (hres == S_OK)
-            {
-                HANDLE  quitEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
-                PyGILState_STATE state = PyGILState_Ensure();
-                Py_AddPendingCall(&quit, (void*)quitEvent);
-                PyGILState_Release(state);
-                WaitForSingleObject(quitEvent, INFINITE);
-                CloseHandle(quitEvent);
-            }
+            warmupInterpreter(defaultMajorVersion, defaultMinorVersion, manifest.getListOption("preloadModules"));
+            warmupDoneTime = startupTimer.elapsed();
         }
-
-        return 0;
+        catch (std::exception&)
+        {}
     }
 
-    HANDLE  m_thread;
+    return 0;
+}
 
-    HANDLE  m_stopEvent;
+void waitInterpreterDiscovery()
+{
+    if (discoveryEvent)
+        WaitForSingleObject(discoveryEvent, INFINITE);
+}
 
-    CComQIPtr<IDebugControl>  m_control;
-};
+void waitInterpreterWarmup()
+{
+    if (startupThread)
+        WaitForSingleObject(startupThread, INFINITE);
+}
+
+bool isInterpreterWarmupRunning()
+{
+    return startupThread && WaitForSingleObject(startupThread, 0) == WAIT_TIMEOUT;
+}
 
 //////////////////////////////////////////////////////////////////////////////
 
@@ -100,7 +122,26 @@ DebugExtensionInitialize(
     PULONG  Flags
 )
 {
-    getDefaultPythonVersion(defaultMajorVersion, defaultMinorVersion);
+    startupTimer.restart();
+
+    classicWindbg = detectClassicWindbg();
+
+    discoveryEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (discoveryEvent)
+        startupThread = CreateThread(NULL, 0, startupRoutine, NULL, 0, NULL);
+
+    if (!startupThread)
+    {
+        // no preload without the background thread: it would hold up .load
+        discoverInterpreter();
+
+        if (discoveryEvent)
+            SetEvent(discoveryEvent);
+    }
+
+    extensionReadyTime = startupTimer.elapsed();
+
     return S_OK;
 }
 
@@ -111,7 +152,23 @@ VOID
 CALLBACK
 DebugExtensionUninitialize()
 {
-   stopAllInterpreter();
+    waitInterpreterWarmup();
+
+    if (startupThread)
+    {
+        CloseHandle(startupThread);
+        startupThread = NULL;
+    }
+
+    if (discoveryEvent)
+    {
+        CloseHandle(discoveryEvent);
+        discoveryEvent = NULL;
+    }
+
+    InterruptWatcher::get().stop();
+
+    stopAllInterpreter();
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -156,6 +213,12 @@ info(
 
         getDefaultPythonVersion(defaultMajor, defaultMinor);
 
+        waitInterpreterDiscovery();
+
+        // the preload thread still fills the loaded interpreter list: only the
+        // default interpreter can be loading, nothing else is loaded yet
+        bool  warmupRunning = isInterpreterWarmupRunning();
+
         sstr << std::endl << "Installed python:" << std::endl << std::endl;
         sstr << std::setw(16) << std::left << "Version:" << std::setw(12) << std::left << "Status: " << std::left << "Image:" <<  std::endl;
         sstr << "------------------------------------------------------------------------------" << std::endl;
@@ -170,7 +233,10 @@ info(
 
                 sstr << std::setw(14) << std::left << make_version(desc.majorVersion, desc.minorVersion);
             
-                sstr << std::setw(12) << std::left << (isInterpreterLoaded(desc.majorVersion, desc.minorVersion) ? "Loaded" : "Unloaded");
+                if (warmupRunning)
+                    sstr << std::setw(12) << std::left << (defaultMajor == desc.majorVersion && defaultMinor == desc.minorVersion ? "Loading" : "Unloaded");
+                else
+                    sstr << std::setw(12) << std::left << (isInterpreterLoaded(desc.majorVersion, desc.minorVersion) ? "Loaded" : "Unloaded");
 
                 sstr << desc.imagePath << std::endl;
             }
@@ -182,6 +248,83 @@ info(
 
         sstr << std::endl;
 
+        sstr << std::fixed << std::setprecision(2) << "Startup: extension ready " << extensionReadyTime << " ms, interpreter discovery ";
+        if (discoveryDoneTime >= 0)
+            sstr << discoveryDoneTime << " ms";
+        else
+            sstr << "in progress";
+        if (warmupDoneTime >= 0)
+            sstr << ", preload " << warmupDoneTime << " ms";
+        else if (warmupRunning)
+            sstr << ", preload in progress";
+        sstr << ", first !py prompt ";
+        if (firstPromptTime >= 0)
+            sstr << firstPromptTime << " ms";
+        else
+            sstr << "not reached";
+        sstr << std::endl << std::endl;
+
+        for (const InterpreterDesc& desc : interpreterList)
+        {
+            InterpreterLoadInfo  loadInfo;
+            if (warmupRunning || !getInterpreterLoadInfo(desc.majorVersion, desc.minorVersion, loadInfo))
+                continue;
+
+            sstr << "Python " << desc.majorVersion << '.' << desc.minorVersion << " load time: "
+                << std::fixed << std::setprecision(2)
+                << loadInfo.loadTime << " ms image, "
+                << loadInfo.resolveTime << " ms C API, "
+                << loadInfo.initTime << " ms init" << std::endl;
+
+            // python keeps the thread of Py_Initialize as its main thread
+            if (!loadInfo.initByCaller)
+            {
+                sstr << "  Initialized by the preload thread: no pending calls, signal handlers or KeyboardInterrupt "
+                    "for commands, CTRL+BREAK is raised as an async exception" << std::endl;
+            }
+
+            sstr << "  C API resolved: " << loadInfo.apiResolved << ", unavailable:";
+            for (const std::string& name : loadInfo.apiUnavailable)
+                sstr << ' ' << name;
+            sstr << std::endl;
+
+            size_t  poolRequests = loadInfo.localPoolHits + loadInfo.localPoolMisses;
+            if (poolRequests > 0 || loadInfo.localPoolReady > 0)
+            {
+                sstr << "  Local pool: " << loadInfo.localPoolReady << " ready, hit rate "
+                    << (poolRequests > 0 ? 100.0 * loadInfo.localPoolHits / poolRequests : 0.0) << "% ("
+                    << loadInfo.localPoolHits << " of " << poolRequests << "), last refill "
+                    << loadInfo.localPoolRefillCount << " in " << loadInfo.localPoolRefillTime << " ms" << std::endl;
+            }
+
+            if (loadInfo.teardownDeferred > 0 || loadInfo.teardownInline > 0 || loadInfo.teardownPending > 0)
+            {
+                sstr << "  Local teardown: " << loadInfo.teardownDeferred << " in background ( "
+                    << (loadInfo.teardownDeferred > 0 ? loadInfo.teardownDeferredTime / loadInfo.teardownDeferred : 0.0)
+                    << " ms avg ), " << loadInfo.teardownInline << " inline, " << loadInfo.teardownPending << " pending" << std::endl;
+            }
+
+            if (loadInfo.codeCacheHits > 0 || loadInfo.codeCacheMisses > 0)
+            {
+                sstr << "  Script code cache: " << loadInfo.codeCacheHits << " hits, "
+                    << loadInfo.codeCacheMisses << " misses" << std::endl;
+            }
+
+            if (loadInfo.sourceCacheHits > 0 || loadInfo.sourceCacheMisses > 0)
+            {
+                sstr << "  Inline code cache: " << loadInfo.sourceCacheHits << " hits, "
+                    << loadInfo.sourceCacheMisses << " misses" << std::endl;
+            }
+
+            if (loadInfo.arenaPeak > 0)
+            {
+                sstr << "  Arena: " << loadInfo.arenaCommitted / 1024 << " KB committed, peak "
+                    << loadInfo.arenaPeak / 1024 << " KB" << std::endl;
+            }
+
+            sstr << std::endl;
+        }
+
         printString(client, DEBUG_OUTPUT_NORMAL, sstr.str().c_str() );
     } 
     catch(std::exception &e)
@@ -221,12 +364,16 @@ selectVersion(
             printString(client, DEBUG_OUTPUT_NORMAL, sstr.str().c_str() );
         }
 
+        waitInterpreterDiscovery();
+
         getPythonVersion(majorVersion, minorVersion);
 
         if ( opts.pyMajorVersion == majorVersion && opts.pyMinorVersion == minorVersion )
         {
             defaultMajorVersion = majorVersion;
             defaultMinorVersion = minorVersion;
+
+            Manifest::get().setDefaultVersion(majorVersion, minorVersion);
         }
         {
             std::stringstream sstr;
@@ -257,6 +404,7 @@ static const char  printUsageMsg[] =
     "\n"
     "!select version\n"
     "\tchange default version of a python interpreter\n"
+    "\t( stored in the interpreter manifest pykd.ini when it exists )\n"
     "\n"
     "!py [version] [options] [file]\n"
     "\trun python script or REPL\n"
@@ -270,13 +418,27 @@ static const char  printUsageMsg[] =
     "\tOptions:\n"
     "\t-g --global  : run code in the common namespace\n"
     "\t-l --local   : run code in the isolated namespace\n"
+    "\t-i --isolated: run code in a fresh namespace of the common interpreter\n"
     "\t-m --module  : run module as the __main__ module ( see the python command line option -m )\n"
+    "\t-c --command : run the next argument as python statements ( in the common namespace by default )\n"
+    "\t-e --eval    : evaluate the next argument as a python expression and print the result\n"
+    "\t--timing     : print script resolve, execution, interpreter release and interrupt watch time\n"
+    "\t--arena      : allocate python objects from an arena released when they are freed\n"
+    "\t               ( for --local and --isolated runs, python 3.5+ )\n"
+    "\n"
+    "\tScript preamble ( leading comment lines, command line options take precedence ):\n"
+    "\t#!python3.x                               : interpreter version\n"
+    "\t# pykd-ext: global | local | isolated     : namespace\n"
+    "\t# pykd-ext: no-pykd                       : no \"from pykd import *\" in the isolated namespace\n"
+    "\t# pykd-ext: preload=module[,module]       : modules imported before the script\n"
     "\n"
     "\tcommand samples:\n"
     "\t\"!py\"                          : run REPL\n"
     "\t\"!py --local\"                  : run REPL in the isolated namespace\n"
+    "\t\"!py -i script.py\"             : run a script file in a fresh namespace without a new interpreter\n"
     "\t\"!py -g script.py 10 \"string\"\" : run a script file with an argument in the commom namespace\n"
     "\t\"!py -m module_name\" : run a named module as the __main__\n"
+    "\t\"!py -e \"hex(reg('rax'))\"\"      : evaluate an expression, compiled once for repeated runs\n"
     "\n"
     "!pip [version] [args]\n"
     "\trun pip package manager\n"
@@ -319,7 +481,7 @@ help(
 
 //////////////////////////////////////////////////////////////////////////////
 
-bool isClassicWindbg()
+static bool detectClassicWindbg()
 {
     std::vector<wchar_t>  exebuffer(0x10000);
     auto  exePathLength = GetModuleFileName(NULL, exebuffer.data(), static_cast<DWORD>(exebuffer.size()));
@@ -330,10 +492,13 @@ bool isClassicWindbg()
     return (exepath.size() >= windbgexe.size()) && (exepath.rfind(windbgexe) == exepath.size() - windbgexe.size());
 }
 
-//////////////////////////////////////////////////////////////////////////////
+bool isClassicWindbg()
+{
+    return classicWindbg;
+}
 
+//////////////////////////////////////////////////////////////////////////////
 
-static const std::regex  shebangRe("^#!\\s*python([2,3])(?:\\.(\\d))?$");
 
 static volatile long recursiveGuard = 0L;
 
@@ -360,6 +525,11 @@ py(
 
     client->SetOutputMask(mask);
 
+    bool  timing = false;
+    double  resolveTime = -1.0;
+    double  execTime = -1.0;
+    size_t  arenaPeak = 0;
+
     try {
 
         if ( 1 < ++recursiveGuard  )
@@ -367,17 +537,27 @@ py(
 
         Options  opts(args);
 
+        timing = opts.timing;
+
         if (opts.showHelp)
             throw std::exception(printUsageMsg);
 
         int  majorVersion = opts.pyMajorVersion;
         int  minorVersion = opts.pyMinorVersion;
 
+        bool  inlineCode = opts.runCommand || opts.runEval;
+
+        if ( inlineCode && opts.args.empty() )
+            throw std::invalid_argument("no code given for -c / -e\n");
+
         std::string  scriptFileName;
 
-        if ( opts.args.size() > 0 && !opts.runModule )
+        if ( opts.args.size() > 0 && !opts.runModule && !inlineCode )
         {
+            PerfTimer  resolveTimer;
             scriptFileName = getScriptFileName(opts.args[0]);
+            resolveTime = resolveTimer.elapsed();
+
             if ( scriptFileName.empty() )
             {
                 const char* msg = "script not found: %s";
@@ -388,43 +568,45 @@ py(
             }
         }
 
-        if ( !opts.runModule && majorVersion == -1 && minorVersion == -1 )
-        {
-            std::ifstream  scriptFile(scriptFileName);
+        // the same view is compiled later, an open failure is reported there
+        std::unique_ptr<MappedFile>  scriptFile;
+        ScriptPreamble  preamble;
 
-            if ( scriptFile.is_open() )
-            {
-                std::string  firstline;
-                std::getline(scriptFile, firstline);
+        if ( !scriptFileName.empty() )
+        {
+            scriptFile.reset(new MappedFile(scriptFileName));
+            preamble = ScriptPreamble(scriptFile->data(), scriptFile->size());
+        }
 
-                std::smatch  mres;
-                if (std::regex_match(firstline, mres, shebangRe))
-                {
-                    majorVersion = atol(std::string(mres[1].first, mres[1].second).c_str());
+        if ( majorVersion == -1 && minorVersion == -1 )
+        {
+            majorVersion = preamble.majorVersion;
+            minorVersion = preamble.minorVersion;
+        }
 
-                    if (mres[2].matched)
-                    {
-                        minorVersion = atol(std::string(mres[2].first, mres[2].second).c_str());
-                    }
-                }
-            }
+        if ( preamble.scopeSet && !opts.scopeSet )
+        {
+            opts.global = preamble.global;
+            opts.isolated = preamble.isolated;
         }
 
         getPythonVersion(majorVersion, minorVersion);
 
+        waitInterpreterWarmup();
+
         AutoInterpreter  autoInterpreter(opts.global, majorVersion, minorVersion);
 
+        AutoArena  autoArena(opts.arena);
+
+        PerfTimer  execTimer;
+
         PyObjectRef  mainMod = PyImport_ImportModule("__main__");
         PyObjectRef  globals = PyObject_GetAttrString(mainMod, "__dict__");
 
-        PyObjectRef  dbgOut = make_pyobject<DbgOut>(client);
-        PySys_SetObject("stdout", dbgOut);
-
-        PyObjectRef  dbgErr = make_pyobject<DbgOut>(client);
-        PySys_SetObject("stderr", dbgErr);
+        if (opts.isolated)
+            globals = getIsolatedNamespace(globals, !preamble.noPykd);
 
-        PyObjectRef dbgIn = make_pyobject<DbgIn>(client);
-        PySys_SetObject("stdin", dbgIn);
+        DbgStreams  streams(client);
 
         InterruptWatch  interruptWatch(client);
 
@@ -434,6 +616,10 @@ py(
         {
             PyObjectRef  result = PyRun_String("import pykd\nfrom pykd import *\n", Py_file_input, globals, globals);
             PyErr_Clear();
+
+            if (firstPromptTime < 0)
+                firstPromptTime = startupTimer.elapsed();
+
             result = PyRun_String("import code\ncode.InteractiveConsole(globals()).interact()\n", Py_file_input, globals, globals);
         }
         else 
@@ -446,6 +632,8 @@ py(
 
                 if ( !scriptFileNameW.empty() )
                     argws[0] = scriptFileNameW;
+                else if ( inlineCode )
+                    argws[0] = L"-c";
                 else
                     argws[0] = L"";
 
@@ -467,20 +655,13 @@ py(
                     result = PyRun_String("import runpy\n", Py_file_input, globals, globals);
                     result = PyRun_String(sstr.str().c_str(), Py_file_input, globals, globals);
                 }
+                else if ( inlineCode )
+                {
+                    PyObjectRef  result = runSourceString(opts.args[0], opts.runEval, globals);
+                }
                 else
                 {
-                    FILE* fs = NULL;
-                    if ((minorVersion >= 5) && (minorVersion <= 13)) {
-                        PyObjectRef pyfile = PyUnicode_FromString(scriptFileName.c_str());
-                        fs = _Py_fopen_obj(pyfile, "r");
-                    } else {
-                        throw std::invalid_argument("Unsupported C API _Py_fopen_obj\n");
-                    }
-
-                    if ( !fs )
-                        throw std::invalid_argument("Unable to open script\n");
-                    
-                      PyObjectRef result = PyRun_FileExFlags(fs, scriptFileName.c_str(), Py_file_input, globals, globals, 1, NULL);
+                    PyObjectRef  result = runScriptFile(scriptFileName, *scriptFile, preamble, globals);
                 }
             }
             else
@@ -489,6 +670,8 @@ py(
 
                 if ( !scriptFileName.empty() )
                     pythonArgs[0] = const_cast<char*>(scriptFileName.c_str());
+                else if ( inlineCode )
+                    pythonArgs[0] = "-c";
                 else
                     pythonArgs[0] = "";
 
@@ -506,22 +689,27 @@ py(
                     result = PyRun_String("import runpy\n", Py_file_input, globals, globals);
                     result = PyRun_String(sstr.str().c_str(), Py_file_input, globals, globals);
                 }
+                else if ( inlineCode )
+                {
+                    PyObjectRef  result = runSourceString(opts.args[0], opts.runEval, globals);
+                }
                 else
                 {
-                    PyObjectRef  pyfile = PyFile_FromString(const_cast<char*>(scriptFileName.c_str()), "r");
-                    if (!pyfile)
-                        throw std::invalid_argument("script not found\n");
-
-                    FILE *fs = PyFile_AsFile(pyfile);
-
-                    PyObjectRef result = PyRun_File(fs, scriptFileName.c_str(), Py_file_input, globals, globals);
+                    PyObjectRef  result = runScriptFile(scriptFileName, *scriptFile, preamble, globals);
                 }
             }
         }
 
+        execTime = execTimer.elapsed();
+
+        if (opts.arena)
+            arenaPeak = getArenaRunPeak();
+
+        streams.flush();
+
         handleException();
 
-        if ( !opts.global )
+        if ( !opts.global || opts.isolated )
             PyDict_Clear(globals);
     }
     catch (std::exception &e)
@@ -529,6 +717,33 @@ py(
         printString(client, DEBUG_OUTPUT_ERROR, e.what() );
     }
 
+    if (timing && execTime >= 0)
+    {
+        double  releaseTime;
+        bool  deferred;
+        getReleaseInfo(releaseTime, deferred);
+
+        std::stringstream  sstr;
+        sstr << std::fixed << std::setprecision(2);
+        if (resolveTime >= 0)
+            sstr << "resolve " << resolveTime << " ms, ";
+        sstr << "execution " << execTime << " ms, interpreter release "
+            << releaseTime << " ms" << (deferred ? " ( teardown deferred )" : "");
+        if (arenaPeak > 0)
+            sstr << ", arena peak " << arenaPeak / 1024 << " KB";
+
+        double  watchOverhead;
+        double  cancelLatency;
+        InterruptWatcher::get().getLastInfo(watchOverhead, cancelLatency);
+
+        sstr << ", interrupt watch " << watchOverhead << " ms";
+        if (cancelLatency >= 0)
+            sstr << ", stopped " << cancelLatency << " ms after CTRL+BREAK";
+        sstr << std::endl;
+
+        printString(client, DEBUG_OUTPUT_NORMAL, sstr.str().c_str());
+    }
+
     client->SetOutputMask(oldMask);
 
     --recursiveGuard;
@@ -559,16 +774,11 @@ pip(
 
         getPythonVersion(majorVersion, minorVersion);
 
-        AutoInterpreter  autoInterpreter(true, majorVersion, minorVersion);
-
-        PyObjectRef  dbgOut = make_pyobject<DbgOut>(client);
-        PySys_SetObject("stdout", dbgOut);
+        waitInterpreterWarmup();
 
-        PyObjectRef  dbgErr = make_pyobject<DbgOut>(client);
-        PySys_SetObject("stderr", dbgErr);
+        AutoInterpreter  autoInterpreter(true, majorVersion, minorVersion);
 
-        PyObjectRef dbgIn = make_pyobject<DbgIn>(client);
-        PySys_SetObject("stdin", dbgIn);
+        DbgStreams  streams(client);
 
         PyObjectRef  mainName = IsPy3() ? PyUnicode_FromString("__main__") : PyString_FromString("__main__");
         PyObjectRef  mainMod = PyImport_Import(mainName);
@@ -615,6 +825,8 @@ pip(
             result = PyRun_String(sstr.str().c_str(), Py_file_input, globals, globals);
         }
 
+        streams.flush();
+
         handleException();
     }
     catch (std::exception &e)
@@ -661,7 +873,7 @@ void handleException()
 
         for (size_t i = 0; i < PyList_Size(lst); ++i)
         {
-            PyObjectBorrowedRef  item = PyList_GetItem(lst, i);
+            PyObjectView  item = PyList_GetItem(lst, i);
             sstr << std::string(convert_from_python(item)) << std::endl;
         }
 
@@ -671,6 +883,85 @@ void handleException()
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// A new namespace for --isolated: copy of a snapshot made once per interpreter
+// right after "from pykd import *" ( or without it for the no-pykd directive ).
+// sys.modules['__main__'] stays the common one.
+PyObject* getIsolatedNamespace(PyObject* mainGlobals, bool importPykd)
+{
+    const char*  key = importPykd ? "namespace.isolated" : "namespace.isolated.nopykd";
+
+    PyObject*  snapshot = getInterpreterObject(key);
+
+    if (!snapshot)
+    {
+        PyObjectRef  ns = PyDict_New();
+        PyDict_SetItemString(ns, "__builtins__", PyDict_GetItemString(mainGlobals, "__builtins__"));
+
+        PyObjectRef  result = PyRun_String(importPykd ? "__name__ = '__main__'\nimport pykd\nfrom pykd import *\n" : "__name__ = '__main__'\n",
+            Py_file_input, ns, ns);
+        PyErr_Clear();
+
+        setInterpreterObject(key, ns);
+        snapshot = ns;
+    }
+
+    return PyDict_Copy(snapshot);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Imports the preload modules of the script preamble, then runs the script code.
+// NULL with the python error set on a failure.
+PyObject* runScriptFile(const std::string& path, MappedFile& file, const ScriptPreamble& preamble, PyObject* globals)
+{
+    if (!preamble.preload.empty())
+    {
+        std::stringstream  sstr;
+        for (const std::string& module : preamble.preload)
+            sstr << "import " << module << std::endl;
+
+        PyObjectRef  result = PyRun_String(sstr.str().c_str(), Py_file_input, globals, globals);
+        if (!result)
+            return NULL;
+    }
+
+    PyObjectRef  code = compileScriptFile(path, file);
+    if (!code)
+        return NULL;
+
+    // the script may be saved while it runs
+    file.close();
+
+    return PyEval_EvalCode(code, globals, globals);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Runs the -c statements or evaluates the -e expression, whose result is shown by
+// sys.displayhook as in the interactive console. NULL with the python error set
+// on a failure.
+PyObject* runSourceString(const std::string& source, bool eval, PyObject* globals)
+{
+    PyObjectRef  code = compileSourceString(source, eval ? Py_eval_input : Py_file_input);
+    if (!code)
+        return NULL;
+
+    PyObjectRef  result = PyEval_EvalCode(code, globals, globals);
+    if (!result || !eval)
+        return result.release();
+
+    PyObjectBorrowedRef  displayhook = PySys_GetObject("displayhook");
+    if (!displayhook)
+        return result.release();
+
+    PyObjectRef  args = PyTuple_New(1);
+    PyTuple_SetItem(args, 0, result.release());
+
+    return PyObject_CallObject(displayhook, args);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
 void getPathList( std::list<std::string>  &pathStringLst)
 {
     PyObjectBorrowedRef  pathLst = PySys_GetObject("path");
@@ -679,7 +970,7 @@ void getPathList( std::list<std::string>  &pathStringLst)
 
     for (size_t i = 0; i < pathLstSize; i++)
     {
-        PyObjectBorrowedRef  pathLstItem = PyList_GetItem(pathLst, i);
+        PyObjectView  pathLstItem = PyList_GetItem(pathLst, i);
 
         if ( IsPy3() )
         {
@@ -710,39 +1001,49 @@ void getPathList( std::list<std::string>  &pathStringLst)
 
 std::string getScriptFileName(const std::string &scriptName)
 {
-    char*  ext = ".py";
+    const char*  ext = ".py";
+
+    // a bare name is looked up in the manifest scriptPath index first
+    ScriptIndex&  index = ScriptIndex::get();
+    if (index.isEnabled() && scriptName.find_first_of("\\/:") == std::string::npos)
+    {
+        std::string  fileName = scriptName;
+        if (fileName.find('.') == std::string::npos)
+            fileName += ext;
+
+        std::string  path = index.find(fileName);
+        if (!path.empty())
+            return path;
+    }
+
+    // one call for any path which fits MAX_PATH, the result is the size needed otherwise
+    std::vector<char>  pathBuffer(MAX_PATH);
 
     DWORD searchResult = SearchPathA(
         NULL,
         scriptName.c_str(),
         ext,
-        0,
-        NULL,
+        static_cast<DWORD>(pathBuffer.size()),
+        &pathBuffer.front(),
         NULL);
 
-    if ( searchResult == 0 )
+    if (searchResult > pathBuffer.size())
     {
-        return "";
-    }
-
-    size_t pos = 0;
-    while ((pos = scriptName.find(std::string("\\\\"), pos)) != std::string::npos) {
-        ++searchResult;
-        pos += std::string("\\\\").length();
-    }
+        pathBuffer.resize(searchResult);
 
-    std::vector<char>  pathBuffer(searchResult);
-
-    searchResult = 
-        SearchPathA(
+        searchResult = SearchPathA(
             NULL,
             scriptName.c_str(),
             ext,
             static_cast<DWORD>(pathBuffer.size()),
             &pathBuffer.front(),
-            NULL );
+            NULL);
+    }
+
+    if (searchResult == 0 || searchResult >= pathBuffer.size())
+        return "";
 
-    return std::string(&pathBuffer.front());
+    return std::string(&pathBuffer.front(), searchResult);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -774,6 +1075,15 @@ void getPythonVersion(int&  majorVersion, int& minorVersion)
 ///////////////////////////////////////////////////////////////////////////////
 
 void getDefaultPythonVersion(int& majorVersion, int& minorVersion)
+{
+    waitInterpreterDiscovery();
+
+    findDefaultPythonVersion(majorVersion, minorVersion);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+void findDefaultPythonVersion(int& majorVersion, int& minorVersion)
 {
     std::list<InterpreterDesc>   interpreterList = getInstalledInterpreter();
 
@@ -823,43 +1133,122 @@ void getDefaultPythonVersion(int& majorVersion, int& minorVersion)
 
 ///////////////////////////////////////////////////////////////////////////////
 
+// Every line of the message is ended by a new line, the last one included. Errors
+// are colored by DML in the classic windbg when the engine prefers DML.
 void printString(PDEBUG_CLIENT client, ULONG mask, const char* str)
 {
     CComQIPtr<IDebugControl>  control = client;
 
-    ULONG  engOpts;
-    bool prefer_dml = SUCCEEDED(control->GetEngineOptions(&engOpts)) && ( (engOpts & DEBUG_ENGOPT_PREFER_DML ) != 0 );
+    bool  dml = false;
+    if (isClassicWindbg() && mask == DEBUG_OUTPUT_ERROR)
+    {
+        ULONG  engOpts;
+        dml = SUCCEEDED(control->GetEngineOptions(&engOpts)) && ( (engOpts & DEBUG_ENGOPT_PREFER_DML ) != 0 );
+    }
+
+    static const char  lineBegin[] = "<col fg=\"errfg\" bg=\"errbg\">";
+    static const char  lineEnd[] = "</col>\n";
+
+    size_t  length = strlen(str);
+
+    std::string  text;
+    text.reserve(dml ? length + length / 4 + sizeof(lineBegin) + sizeof(lineEnd) : length + 1);
+
+    if (!dml)
+    {
+        text.append(str, length);
+        text += '\n';
+    }
+    else
+    {
+        text += lineBegin;
 
-    std::stringstream  sstr(str);
-    while( sstr.good() )
+        for (const char* p = str; *p; ++p)
+        {
+            switch (*p)
+            {
+            case '&':
+                text += "&amp;";
+                break;
+            case '<':
+                text += "&lt;";
+                break;
+            case '>':
+                text += "&gt;";
+                break;
+            case '\n':
+                text += lineEnd;
+                text += lineBegin;
+                break;
+            default:
+                text += *p;
+            }
+        }
+
+        text += lineEnd;
+    }
+
+    // One call per chunk as in DbgOutBuffer::emit, the engine truncates huge output.
+    // A chunk ends after a new line if there is one in reach ( a new line right after
+    // the chunk size included ). A DML line longer than that is split outside of
+    // entities and tags, and each part gets its own color tags.
+    static const size_t  chunkSize = 0x2000;
+
+    bool  lineSplit = false;
+
+    for (size_t pos = 0; pos < text.size(); )
     {
-        std::string  line;
-        std::getline(sstr, line);
+        size_t  chunkLength = text.size() - pos;
+        bool  reopen = lineSplit;
+
+        lineSplit = false;
 
-        if (isClassicWindbg() && prefer_dml && mask == DEBUG_OUTPUT_ERROR )
+        if (chunkLength > chunkSize + 1)
         {
-            line = std::regex_replace(line, std::regex("&"), "&amp;");
-            line = std::regex_replace(line, std::regex("<"), "&lt;");
-            line = std::regex_replace(line, std::regex(">"), "&gt;");
-
-            control->ControlledOutput(
-                DEBUG_OUTCTL_AMBIENT_DML,
-                mask,
-                "<col fg=\"errfg\" bg=\"errbg\">%s</col>\n",
-                line.c_str()
-                );
+            size_t  newLine = text.rfind('\n', pos + chunkSize);
+            if (newLine != std::string::npos && newLine >= pos)
+            {
+                chunkLength = newLine - pos + 1;
+            }
+            else
+            {
+                chunkLength = chunkSize;
+                lineSplit = dml;
+
+                // escaped text has '&' and '<' only at the start of an entity or a tag
+                size_t  markup = text.find_last_of("&<", pos + chunkLength - 1);
+                size_t  markupEnd = text.find_last_of(";>", pos + chunkLength - 1);
+                if (dml && markup != std::string::npos && markup > pos && (markupEnd == std::string::npos || markupEnd < markup))
+                    chunkLength = markup - pos;
+            }
         }
-        else
+
+        if (reopen || lineSplit)
         {
-            control->ControlledOutput(
-                DEBUG_OUTCTL_AMBIENT_TEXT,
-                mask,
-                "%s\n",
-                line.c_str()
-                );
+            std::string  chunk = reopen ? lineBegin : "";
+            chunk.append(text, pos, chunkLength);
+            if (lineSplit)
+                chunk += "</col>";
+
+            control->ControlledOutput(DEBUG_OUTCTL_AMBIENT_DML, mask, "%s", chunk.c_str());
+
+            pos += chunkLength;
+            continue;
         }
-    }
 
+        char  next = text[pos + chunkLength];
+        text[pos + chunkLength] = '\0';
+
+        control->ControlledOutput(
+            dml ? DEBUG_OUTCTL_AMBIENT_DML : DEBUG_OUTCTL_AMBIENT_TEXT,
+            mask,
+            "%s",
+            text.c_str() + pos
+            );
+
+        text[pos + chunkLength] = next;
+        pos += chunkLength;
+    }
 }
 
 ///////////////////////////////////////////////////////////////////////////////